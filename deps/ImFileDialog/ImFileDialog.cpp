@@ -3,7 +3,12 @@
 #endif
 #include "ImFileDialog.h"
 
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <algorithm>
 #include <sys/stat.h>
 #define IMGUI_DEFINE_MATH_OPERATORS
@@ -23,11 +28,26 @@
 #else
 #include <unistd.h>
 #include <pwd.h>
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
 #endif
 
 #define ICON_SIZE ImGui::GetFont()->FontSize + 3
 #define GUI_ELEMENT_SIZE (std::max)(GImGui->FontSize + 10.f, 24.f)
 #define DEFAULT_ICON_SIZE 32
+#define PREVIEW_SIZE 256 // biggest icon is 32 + 16 * 25 pixels, previews needn't be much larger
+#define MAX_PREVIEW_THREADS 4
+#define PREVIEW_UPLOAD_BYTES (1024 * 1024) // per frame, 16 full size previews
+#define PREVIEW_UPLOAD_MS 2.0
+#define PROBE_THREADS 2
+#define MAX_PROBE_CACHE_ENTRIES 100000
+#define MAX_CACHED_PATH 4096 // bytes, cache indexes with longer paths are corrupt
+#define MAX_CACHED_CODEC_NAME 256
+#define MAX_PROBED_DIMENSION 65536
+#define PARALLEL_SORT_MIN 16384 // entries, below that the threads cost more than they save
+#define INSERT_SORTED_MAX 8 // entries put in place one by one, more are merged in
 #define PI 3.141592f
 
 static std::string u8StringToString(const std::u8string& str) {
@@ -285,11 +305,9 @@ namespace ifd {
 	}
 	bool FileIcon(const char* label, bool isSelected, ImTextureID icon, ImVec2 size, bool hasPreview, int previewWidth, int previewHeight)
 	{
-		ImGuiStyle& style = ImGui::GetStyle();
 		ImGuiContext& g = *GImGui;
 		ImGuiWindow* window = g.CurrentWindow;
 
-		float windowSpace = ImGui::GetWindowPos().x + ImGui::GetWindowContentRegionMax().x;
 		ImVec2 pos = window->DC.CursorPos;
 		bool ret = false;
 
@@ -329,14 +347,560 @@ namespace ifd {
 		window->DrawList->AddText(g.Font, g.FontSize, ImVec2(pos.x + (size.x - textSize.x) / 2.0f, pos.y + iconSize), ImGui::ColorConvertFloat4ToU32(ImGui::GetStyle().Colors[ImGuiCol_Text]), label, 0, size.x);
 
 
-		float lastButtomPos = ImGui::GetItemRectMax().x;
-		float thisButtonPos = lastButtomPos + style.ItemSpacing.x + size.x; // Expected position if next button was on same line
-		if (thisButtonPos < windowSpace)
-			ImGui::SameLine();
-
 		return ret;
 	}
 
+	/* PREVIEW CACHE */
+	static FILE* OpenFile(const std::filesystem::path& path, const char* mode)
+	{
+#ifdef _WIN32
+		std::wstring modeW(mode, mode + strlen(mode));
+		return _wfopen(path.wstring().c_str(), modeW.c_str());
+#else
+		return fopen(path.c_str(), mode);
+#endif
+	}
+	static bool SeekFile(FILE* file, uint64_t offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+	static uint64_t FileSize(FILE* file)
+	{
+#ifdef _WIN32
+		if (_fseeki64(file, 0, SEEK_END) != 0)
+			return 0;
+		return (uint64_t)_ftelli64(file);
+#else
+		if (fseeko(file, 0, SEEK_END) != 0)
+			return 0;
+		return (uint64_t)ftello(file);
+#endif
+	}
+
+	// Previews kept between runs. Tiles of RGBA pixels are appended to a pack
+	// file and found through an index of path, size and date that is read when
+	// the cache is opened and written back by Save(). The pack is memory mapped
+	// where possible, so a hit is a copy out of the page cache. Past the size
+	// limit the least recently used tiles are dropped. The pack is rewritten
+	// without the dead tiles by the preview thread storing a tile once it is
+	// twice the limit, or when the cache is closed at shutdown if it holds more
+	// dead tiles than live ones; never on the UI thread.
+	class PreviewCache {
+	public:
+		PreviewCache(const std::filesystem::path& directory, size_t maxBytes);
+		~PreviewCache();
+
+		bool Find(const std::string& path, size_t size, time_t date, FileDialog::PreviewImage& out);
+		void Store(const std::string& path, size_t size, time_t date, const FileDialog::PreviewImage& image);
+		void Save(); // the index only, skipped while a preview thread holds the cache
+		size_t Bytes() const;
+
+		std::atomic<size_t> Hits{ 0 }, Misses{ 0 };
+
+	private:
+		struct Entry {
+			uint64_t Size;
+			int64_t Date;
+			uint64_t Offset;
+			uint32_t Width, Height;
+			uint64_t LastUsed;
+		};
+		static uint64_t m_tileBytes(const Entry& entry) { return (uint64_t)entry.Width * entry.Height * 4; }
+		void m_load();
+		void m_map();
+		void m_unmap();
+		bool m_read(const Entry& entry, uint8_t* out);
+		void m_evict(uint64_t target);
+		void m_compact();
+		void m_save();
+
+		std::filesystem::path m_packPath, m_indexPath;
+		uint64_t m_maxBytes;
+		mutable std::mutex m_mutex;
+		std::unordered_map<std::string, Entry> m_entries;
+		std::atomic<uint64_t> m_bytes; // live tiles, read by Bytes() without the lock
+		uint64_t m_packSize; // live and dead tiles
+		uint64_t m_clock;    // source of Entry::LastUsed
+		bool m_dirty;
+		FILE* m_pack;
+		const uint8_t* m_mapped;
+		uint64_t m_mappedSize;
+	};
+
+	static const char PREVIEW_CACHE_MAGIC[4] = { 'I', 'F', 'D', 'C' };
+	static const uint32_t PREVIEW_CACHE_VERSION = 1;
+
+	PreviewCache::PreviewCache(const std::filesystem::path& directory, size_t maxBytes) {
+		m_packPath = directory / "previews.pack";
+		m_indexPath = directory / "previews.index";
+		m_maxBytes = maxBytes;
+		m_bytes = 0;
+		m_packSize = 0;
+		m_clock = 0;
+		m_dirty = false;
+		m_mapped = nullptr;
+		m_mappedSize = 0;
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+		m_pack = OpenFile(m_packPath, "r+b");
+		if (m_pack == nullptr)
+			m_pack = OpenFile(m_packPath, "w+b");
+		if (m_pack != nullptr)
+			m_load();
+	}
+	PreviewCache::~PreviewCache() {
+		{
+			// the preview threads are gone by now, so a long rewrite blocks nobody
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_pack != nullptr && m_dirty && m_packSize - m_bytes > m_bytes)
+				m_compact();
+			m_save();
+		}
+		m_unmap();
+		if (m_pack != nullptr)
+			fclose(m_pack);
+	}
+	void PreviewCache::m_load()
+	{
+		m_packSize = FileSize(m_pack);
+
+		FILE* index = OpenFile(m_indexPath, "rb");
+		if (index == nullptr)
+			return;
+
+		char magic[4];
+		uint32_t version = 0;
+		uint64_t count = 0, clock = 0;
+		if (fread(magic, 4, 1, index) == 1 && memcmp(magic, PREVIEW_CACHE_MAGIC, 4) == 0 &&
+			fread(&version, sizeof(version), 1, index) == 1 && version == PREVIEW_CACHE_VERSION &&
+			fread(&count, sizeof(count), 1, index) == 1 && fread(&clock, sizeof(clock), 1, index) == 1) {
+			m_clock = clock;
+			std::string path;
+			for (uint64_t i = 0; i < count; i++) {
+				Entry entry;
+				uint32_t pathLength;
+				if (fread(&entry, sizeof(entry), 1, index) != 1 || fread(&pathLength, sizeof(pathLength), 1, index) != 1)
+					break;
+				// nothing after an implausible entry can be trusted
+				if (pathLength > MAX_CACHED_PATH || entry.Width == 0 || entry.Height == 0 ||
+					entry.Width > PREVIEW_SIZE || entry.Height > PREVIEW_SIZE)
+					break;
+				path.resize(pathLength);
+				if (pathLength > 0 && fread(path.data(), pathLength, 1, index) != 1)
+					break;
+
+				// tiles past the end of the pack were lost, e.g. in a crash before Save()
+				uint64_t bytes = m_tileBytes(entry);
+				if (entry.Offset > m_packSize || bytes > m_packSize - entry.Offset)
+					continue;
+				m_entries[path] = entry;
+				m_bytes += bytes;
+			}
+		}
+		fclose(index);
+
+		m_map();
+	}
+	void PreviewCache::m_map()
+	{
+#ifndef _WIN32
+		m_unmap();
+		if (m_packSize == 0)
+			return;
+		fflush(m_pack);
+		void* data = mmap(nullptr, m_packSize, PROT_READ, MAP_SHARED, fileno(m_pack), 0);
+		if (data != MAP_FAILED) {
+			m_mapped = static_cast<const uint8_t*>(data);
+			m_mappedSize = m_packSize;
+		}
+#endif
+	}
+	void PreviewCache::m_unmap()
+	{
+#ifndef _WIN32
+		if (m_mapped != nullptr)
+			munmap(const_cast<uint8_t*>(m_mapped), m_mappedSize);
+#endif
+		m_mapped = nullptr;
+		m_mappedSize = 0;
+	}
+	bool PreviewCache::m_read(const Entry& entry, uint8_t* out)
+	{
+		uint64_t bytes = m_tileBytes(entry);
+		if (entry.Offset + bytes <= m_mappedSize) {
+			memcpy(out, m_mapped + entry.Offset, bytes);
+			return true;
+		}
+		// appended since the pack was mapped
+		return SeekFile(m_pack, entry.Offset) && fread(out, 1, bytes, m_pack) == bytes;
+	}
+	bool PreviewCache::Find(const std::string& path, size_t size, time_t date, FileDialog::PreviewImage& out)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(path);
+		if (m_pack == nullptr || it == m_entries.end() || it->second.Size != size || it->second.Date != (int64_t)date) {
+			Misses++;
+			return false;
+		}
+
+		out.Width = it->second.Width;
+		out.Height = it->second.Height;
+		out.Data.resize(m_tileBytes(it->second));
+		if (!m_read(it->second, out.Data.data())) {
+			Misses++;
+			return false;
+		}
+		it->second.LastUsed = ++m_clock;
+		m_dirty = true;
+		Hits++;
+		return true;
+	}
+	void PreviewCache::Store(const std::string& path, size_t size, time_t date, const FileDialog::PreviewImage& image)
+	{
+		uint64_t bytes = (uint64_t)image.Width * image.Height * 4;
+		if (bytes == 0 || bytes > m_maxBytes || image.Data.size() < bytes || path.size() > MAX_CACHED_PATH)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pack == nullptr || !SeekFile(m_pack, m_packSize) || fwrite(image.Data.data(), 1, bytes, m_pack) != bytes)
+			return;
+
+		// a changed file leaves its old tile behind as dead space
+		auto it = m_entries.find(path);
+		if (it != m_entries.end())
+			m_bytes -= m_tileBytes(it->second);
+		m_entries[path] = Entry{ size, (int64_t)date, m_packSize, (uint32_t)image.Width, (uint32_t)image.Height, ++m_clock };
+		m_packSize += bytes;
+		m_bytes += bytes;
+		m_dirty = true;
+
+		if (m_bytes > m_maxBytes)
+			m_evict(m_maxBytes / 10 * 9);
+		if (m_packSize > m_maxBytes * 2)
+			m_compact();
+	}
+	void PreviewCache::m_evict(uint64_t target)
+	{
+		std::vector<std::unordered_map<std::string, Entry>::iterator> order;
+		order.reserve(m_entries.size());
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+			order.push_back(it);
+		std::sort(order.begin(), order.end(), [](const auto& left, const auto& right) {
+			return left->second.LastUsed < right->second.LastUsed;
+		});
+
+		for (size_t i = 0; i < order.size() && m_bytes > target; i++) {
+			m_bytes -= m_tileBytes(order[i]->second);
+			m_entries.erase(order[i]);
+		}
+		m_dirty = true;
+	}
+	void PreviewCache::m_compact()
+	{
+		std::filesystem::path tempPath = m_packPath;
+		tempPath += ".tmp";
+		FILE* out = OpenFile(tempPath, "wb");
+		if (out == nullptr)
+			return;
+
+		// copy the live tiles in pack order, so reading is sequential
+		std::vector<Entry*> order;
+		order.reserve(m_entries.size());
+		for (auto& entry : m_entries)
+			order.push_back(&entry.second);
+		std::sort(order.begin(), order.end(), [](const Entry* left, const Entry* right) {
+			return left->Offset < right->Offset;
+		});
+
+		std::vector<uint64_t> offsets(order.size());
+		std::vector<uint8_t> tile;
+		uint64_t offset = 0;
+		bool ok = true;
+		for (size_t i = 0; ok && i < order.size(); i++) {
+			tile.resize(m_tileBytes(*order[i]));
+			ok = m_read(*order[i], tile.data()) && fwrite(tile.data(), 1, tile.size(), out) == tile.size();
+			offsets[i] = offset;
+			offset += tile.size();
+		}
+		ok = fclose(out) == 0 && ok;
+
+		std::error_code ec;
+		if (!ok) {
+			std::filesystem::remove(tempPath, ec);
+			return;
+		}
+
+		m_unmap();
+		fclose(m_pack);
+		std::filesystem::rename(tempPath, m_packPath, ec);
+		m_pack = OpenFile(m_packPath, "r+b");
+		if (ec || m_pack == nullptr) {
+			// start over rather than point into the wrong file
+			if (m_pack != nullptr)
+				fclose(m_pack);
+			m_pack = OpenFile(m_packPath, "w+b");
+			m_entries.clear();
+			m_bytes = m_packSize = 0;
+			m_dirty = true;
+			return;
+		}
+		for (size_t i = 0; i < order.size(); i++)
+			order[i]->Offset = offsets[i];
+		m_packSize = offset;
+		m_dirty = true;
+		m_map();
+	}
+	void PreviewCache::Save()
+	{
+		// called from the UI thread; a preview thread may be rewriting the pack,
+		// in which case the index is written by the next Save or at shutdown
+		std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+		if (lock.owns_lock())
+			m_save();
+	}
+	void PreviewCache::m_save()
+	{
+		if (m_pack == nullptr || !m_dirty)
+			return;
+		fflush(m_pack);
+
+		std::filesystem::path tempPath = m_indexPath;
+		tempPath += ".tmp";
+		FILE* index = OpenFile(tempPath, "wb");
+		if (index == nullptr)
+			return;
+
+		uint64_t count = m_entries.size();
+		bool ok = fwrite(PREVIEW_CACHE_MAGIC, 4, 1, index) == 1 &&
+			fwrite(&PREVIEW_CACHE_VERSION, sizeof(PREVIEW_CACHE_VERSION), 1, index) == 1 &&
+			fwrite(&count, sizeof(count), 1, index) == 1 && fwrite(&m_clock, sizeof(m_clock), 1, index) == 1;
+		for (auto it = m_entries.begin(); ok && it != m_entries.end(); ++it) {
+			uint32_t pathLength = (uint32_t)it->first.size();
+			ok = fwrite(&it->second, sizeof(Entry), 1, index) == 1 && fwrite(&pathLength, sizeof(pathLength), 1, index) == 1 &&
+				(pathLength == 0 || fwrite(it->first.data(), pathLength, 1, index) == 1);
+		}
+		ok = fclose(index) == 0 && ok;
+
+		std::error_code ec;
+		if (ok)
+			std::filesystem::rename(tempPath, m_indexPath, ec);
+		else
+			std::filesystem::remove(tempPath, ec);
+		m_dirty = !ok || ec;
+	}
+	size_t PreviewCache::Bytes() const
+	{
+		return m_bytes;
+	}
+
+	// Probe results kept between runs. They are a few dozen bytes each, so the
+	// whole index is read when the cache is opened and written back by Save();
+	// past MAX_PROBE_CACHE_ENTRIES the least recently used are dropped.
+	class ProbeCache {
+	public:
+		ProbeCache(const std::filesystem::path& directory);
+		~ProbeCache();
+
+		bool Find(const std::string& path, size_t size, time_t date, FileDialog::MediaInfo& out);
+		void Store(const std::string& path, size_t size, time_t date, const FileDialog::MediaInfo& info);
+		void Save();
+
+	private:
+		struct Record {
+			uint64_t Size;
+			int64_t Date;
+			double Duration;
+			double FrameRate;
+			int32_t Width, Height;
+			uint64_t LastUsed;
+		};
+		struct Entry {
+			Record Data;
+			std::string Codec;
+		};
+		static bool m_plausible(const Record& data) {
+			return std::isfinite(data.Duration) && data.Duration >= 0 && std::isfinite(data.FrameRate) && data.FrameRate >= 0 &&
+				data.Width >= 0 && data.Width <= MAX_PROBED_DIMENSION && data.Height >= 0 && data.Height <= MAX_PROBED_DIMENSION;
+		}
+		void m_load();
+
+		std::filesystem::path m_indexPath;
+		std::mutex m_mutex;
+		std::unordered_map<std::string, Entry> m_entries;
+		uint64_t m_clock; // source of Record::LastUsed
+		bool m_dirty;
+	};
+
+	static const char PROBE_CACHE_MAGIC[4] = { 'I', 'F', 'D', 'P' };
+	static const uint32_t PROBE_CACHE_VERSION = 1;
+
+	ProbeCache::ProbeCache(const std::filesystem::path& directory) {
+		m_indexPath = directory / "probes.index";
+		m_clock = 0;
+		m_dirty = false;
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+		m_load();
+	}
+	ProbeCache::~ProbeCache() {
+		Save();
+	}
+	void ProbeCache::m_load()
+	{
+		FILE* index = OpenFile(m_indexPath, "rb");
+		if (index == nullptr)
+			return;
+
+		char magic[4];
+		uint32_t version = 0;
+		uint64_t count = 0, clock = 0;
+		if (fread(magic, 4, 1, index) == 1 && memcmp(magic, PROBE_CACHE_MAGIC, 4) == 0 &&
+			fread(&version, sizeof(version), 1, index) == 1 && version == PROBE_CACHE_VERSION &&
+			fread(&count, sizeof(count), 1, index) == 1 && fread(&clock, sizeof(clock), 1, index) == 1) {
+			m_clock = clock;
+			std::string path;
+			for (uint64_t i = 0; i < count; i++) {
+				Entry entry;
+				uint32_t codecLength, pathLength;
+				if (fread(&entry.Data, sizeof(Record), 1, index) != 1 || fread(&codecLength, sizeof(codecLength), 1, index) != 1)
+					break;
+				// nothing after an implausible record can be trusted
+				if (!m_plausible(entry.Data) || codecLength > MAX_CACHED_CODEC_NAME)
+					break;
+				entry.Codec.resize(codecLength);
+				if ((codecLength > 0 && fread(entry.Codec.data(), codecLength, 1, index) != 1) ||
+					fread(&pathLength, sizeof(pathLength), 1, index) != 1 || pathLength > MAX_CACHED_PATH)
+					break;
+				path.resize(pathLength);
+				if (pathLength > 0 && fread(path.data(), pathLength, 1, index) != 1)
+					break;
+				m_entries[path] = std::move(entry);
+			}
+		}
+		fclose(index);
+	}
+	bool ProbeCache::Find(const std::string& path, size_t size, time_t date, FileDialog::MediaInfo& out)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(path);
+		if (it == m_entries.end() || it->second.Data.Size != size || it->second.Data.Date != (int64_t)date)
+			return false;
+
+		const Record& data = it->second.Data;
+		out.Duration = data.Duration;
+		out.FrameRate = data.FrameRate;
+		out.Width = data.Width;
+		out.Height = data.Height;
+		out.Codec = it->second.Codec;
+		it->second.Data.LastUsed = ++m_clock;
+		m_dirty = true;
+		return true;
+	}
+	void ProbeCache::Store(const std::string& path, size_t size, time_t date, const FileDialog::MediaInfo& info)
+	{
+		// m_load would take anything else for a corrupt index
+		Record data{ size, (int64_t)date, info.Duration, info.FrameRate, info.Width, info.Height, 0 };
+		if (!m_plausible(data) || info.Codec.size() > MAX_CACHED_CODEC_NAME || path.size() > MAX_CACHED_PATH)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry& entry = m_entries[path];
+		entry.Data = data;
+		entry.Data.LastUsed = ++m_clock;
+		entry.Codec = info.Codec;
+		m_dirty = true;
+
+		if (m_entries.size() > MAX_PROBE_CACHE_ENTRIES) {
+			std::vector<std::unordered_map<std::string, Entry>::iterator> order;
+			order.reserve(m_entries.size());
+			for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+				order.push_back(it);
+			size_t drop = m_entries.size() - MAX_PROBE_CACHE_ENTRIES / 10 * 9;
+			std::nth_element(order.begin(), order.begin() + drop, order.end(), [](const auto& left, const auto& right) {
+				return left->second.Data.LastUsed < right->second.Data.LastUsed;
+			});
+			for (size_t i = 0; i < drop; i++)
+				m_entries.erase(order[i]);
+		}
+	}
+	void ProbeCache::Save()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_dirty)
+			return;
+
+		std::filesystem::path tempPath = m_indexPath;
+		tempPath += ".tmp";
+		FILE* index = OpenFile(tempPath, "wb");
+		if (index == nullptr)
+			return;
+
+		uint64_t count = m_entries.size();
+		bool ok = fwrite(PROBE_CACHE_MAGIC, 4, 1, index) == 1 &&
+			fwrite(&PROBE_CACHE_VERSION, sizeof(PROBE_CACHE_VERSION), 1, index) == 1 &&
+			fwrite(&count, sizeof(count), 1, index) == 1 && fwrite(&m_clock, sizeof(m_clock), 1, index) == 1;
+		for (auto it = m_entries.begin(); ok && it != m_entries.end(); ++it) {
+			uint32_t codecLength = (uint32_t)it->second.Codec.size();
+			uint32_t pathLength = (uint32_t)it->first.size();
+			ok = fwrite(&it->second.Data, sizeof(Record), 1, index) == 1 && fwrite(&codecLength, sizeof(codecLength), 1, index) == 1 &&
+				(codecLength == 0 || fwrite(it->second.Codec.data(), codecLength, 1, index) == 1) &&
+				fwrite(&pathLength, sizeof(pathLength), 1, index) == 1 &&
+				(pathLength == 0 || fwrite(it->first.data(), pathLength, 1, index) == 1);
+		}
+		ok = fclose(index) == 0 && ok;
+
+		std::error_code ec;
+		if (ok)
+			std::filesystem::rename(tempPath, m_indexPath, ec);
+		else
+			std::filesystem::remove(tempPath, ec);
+		m_dirty = !ok || ec;
+	}
+
+	// Shrinks a preview to fit a size x size box, averaging the source pixels
+	// that fall on every destination pixel.
+	static void ScalePreview(FileDialog::PreviewImage& image, int size)
+	{
+		if (image.Width <= size && image.Height <= size)
+			return;
+
+		float scale = std::min<float>((float)size / image.Width, (float)size / image.Height);
+		int width = std::max(1, (int)(image.Width * scale + 0.5f));
+		int height = std::max(1, (int)(image.Height * scale + 0.5f));
+
+		std::vector<uint8_t> scaled((size_t)width * height * 4);
+		for (int y = 0; y < height; y++) {
+			int y0 = (int)((int64_t)y * image.Height / height);
+			int y1 = std::max(y0 + 1, (int)((int64_t)(y + 1) * image.Height / height));
+			for (int x = 0; x < width; x++) {
+				int x0 = (int)((int64_t)x * image.Width / width);
+				int x1 = std::max(x0 + 1, (int)((int64_t)(x + 1) * image.Width / width));
+
+				uint32_t sum[4] = { 0, 0, 0, 0 };
+				for (int sy = y0; sy < y1; sy++) {
+					const uint8_t* row = image.Data.data() + ((size_t)sy * image.Width + x0) * 4;
+					for (int sx = x0; sx < x1; sx++, row += 4)
+						for (int c = 0; c < 4; c++)
+							sum[c] += row[c];
+				}
+				uint32_t count = (uint32_t)((y1 - y0) * (x1 - x0));
+				uint8_t* out = scaled.data() + ((size_t)y * width + x) * 4;
+				for (int c = 0; c < 4; c++)
+					out[c] = (uint8_t)((sum[c] + count / 2) / count);
+			}
+		}
+
+		image.Data = std::move(scaled);
+		image.Width = width;
+		image.Height = height;
+	}
+
 	FileDialog::FileData::FileData(const std::filesystem::path& path) {
 		std::error_code ec;
 		Path = path;
@@ -347,11 +911,43 @@ namespace ifd {
 		stat(u8StringToString(path.u8string()).c_str(), &attr);
 		DateModified = attr.st_ctime;
 
-		HasIconPreview = false;
-		IconPreview = nullptr;
-		IconPreviewData = nullptr;
-		IconPreviewHeight = 0;
-		IconPreviewWidth = 0;
+		Id = 0;
+		DisplayName = u8StringToString(path.filename().u8string());
+		if (DisplayName.empty())
+			DisplayName = u8StringToString(path.u8string()); // drive
+		SearchName = DisplayName;
+		std::transform(SearchName.begin(), SearchName.end(), SearchName.begin(), ::tolower);
+
+		// entries are made on the directory reading thread, std::localtime isn't safe there
+		struct tm tm;
+#ifdef _WIN32
+		bool hasTime = localtime_s(&tm, &DateModified) == 0;
+#else
+		bool hasTime = localtime_r(&DateModified, &tm) != nullptr;
+#endif
+		char buffer[64];
+		if (hasTime) {
+			snprintf(buffer, sizeof(buffer), "%d/%d/%d %02d:%02d", tm.tm_mon + 1, tm.tm_mday, 1900 + tm.tm_year, tm.tm_hour, tm.tm_min);
+			DateString = buffer;
+		}
+		else
+			DateString = "---";
+		snprintf(buffer, sizeof(buffer), "%.3f KiB", Size / 1024.0f);
+		SizeString = buffer;
+
+#ifdef _WIN32
+		// the shell gives every file of a type the same icon, except for these
+		// and folders, which can carry their own
+		std::string extension = u8StringToString(path.extension().u8string());
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if (IsDirectory || extension.empty() || extension == ".exe" || extension == ".ico" || extension == ".lnk" ||
+			extension == ".url" || extension == ".cur" || extension == ".ani")
+			IconKey = u8StringToString(path.u8string());
+		else
+			IconKey = "*" + extension; // can't be a path
+#else
+		IconKey = IsDirectory ? "<directory>" : "<file>"; // can't be absolute paths
+#endif
 	}
 
 	FileDialog::FileDialog() {
@@ -368,8 +964,27 @@ namespace ifd {
 		m_selectedFileItem = -1;
 		m_zoom = 1.0f;
 
-		m_previewLoader = nullptr;
-		m_previewLoaderRunning = false;
+		m_previewCursor = 0;
+		m_previewsLoaded = 0;
+		m_previewThreadCount = 0;
+		m_previewGeneration = 0;
+		m_previewStop = false;
+		m_uploadBytesPerFrame = PREVIEW_UPLOAD_BYTES;
+		m_uploadMsPerFrame = PREVIEW_UPLOAD_MS;
+		m_uploadWorstMs = 0;
+
+		m_probeGeneration = 0;
+		m_probeStop = false;
+
+		m_directoryFirstMs = 0;
+		m_directoryTotalMs = 0;
+
+		m_watchFd = -1;
+		m_watchOverflow = false;
+
+		m_filteredFuzzy = false;
+		m_fuzzySearch = false;
+		m_searchMs = 0;
 
 		m_setDirectory(std::filesystem::current_path(), false);
 
@@ -445,6 +1060,10 @@ namespace ifd {
 #endif
 	}
 	FileDialog::~FileDialog() {
+		m_cancelDirectoryJob();
+		m_stopWatching();
+		m_stopPreviewLoader();
+		m_stopProbes();
 		m_clearIconPreview();
 		m_clearIcons();
 
@@ -463,7 +1082,7 @@ namespace ifd {
 		m_calledOpenPopup = false;
 		m_result.clear();
 		m_inputTextbox[0] = 0;
-		m_selections.clear();
+		m_clearSelections();
 		m_selectedFileItem = -1;
 		m_isMultiselect = false;
 		m_type = IFD_DIALOG_SAVE;
@@ -487,7 +1106,7 @@ namespace ifd {
 		m_calledOpenPopup = false;
 		m_result.clear();
 		m_inputTextbox[0] = 0;
-		m_selections.clear();
+		m_clearSelections();
 		m_selectedFileItem = -1;
 		m_isMultiselect = isMultiselect;
 		m_type = filter.empty() ? IFD_DIALOG_DIRECTORY : IFD_DIALOG_FILE;
@@ -522,6 +1141,8 @@ namespace ifd {
 	}
 	void FileDialog::Close()
 	{
+		m_cancelDirectoryJob();
+		m_stopWatching();
 		m_currentKey.clear();
 		m_backHistory = std::stack<std::filesystem::path>();
 		m_forwardHistory = std::stack<std::filesystem::path>();
@@ -539,6 +1160,11 @@ namespace ifd {
 		// free icon textures
 		m_clearIconPreview();
 		m_clearIcons();
+
+		if (m_previewCache)
+			m_previewCache->Save();
+		if (m_probeCache)
+			m_probeCache->Save();
 	}
 
 	void FileDialog::RemoveFavorite(const std::string& path)
@@ -582,15 +1208,17 @@ namespace ifd {
 		bool multiselect = isCtrlDown && m_isMultiselect;
 
 		if (!multiselect) {
-			m_selections.clear();
+			m_clearSelections();
 			m_selections.push_back(path);
+			m_selectionSet.insert(path);
 		}
 		else {
-			auto it = std::find(m_selections.begin(), m_selections.end(), path);
-			if (it != m_selections.end())
-				m_selections.erase(it);
-			else
+			if (m_selectionSet.erase(path))
+				m_selections.erase(std::find(m_selections.begin(), m_selections.end(), path));
+			else {
 				m_selections.push_back(path);
+				m_selectionSet.insert(path);
+			}
 		}
 
 		if (m_selections.size() == 1) {
@@ -613,6 +1241,11 @@ namespace ifd {
 		}
 	}
 
+	void FileDialog::m_clearSelections()
+	{
+		m_selections.clear();
+		m_selectionSet.clear();
+	}
 	bool FileDialog::m_finalize(const std::string& filename)
 	{
 		bool hasResult = (!filename.empty() && m_type != IFD_DIALOG_DIRECTORY) || m_type == IFD_DIALOG_DIRECTORY;
@@ -709,6 +1342,16 @@ namespace ifd {
 		}
 	}
 
+	void* FileDialog::m_getIcon(const FileData& entry)
+	{
+		auto it = m_icons.find(entry.IconKey);
+		if (it != m_icons.end())
+			return it->second;
+
+		void* icon = m_getIcon(entry.Path);
+		m_icons[entry.IconKey] = icon;
+		return icon;
+	}
 	void* FileDialog::m_getIcon(const std::filesystem::path& path)
 	{
 #ifdef _WIN32
@@ -846,9 +1489,13 @@ namespace ifd {
 	void FileDialog::m_refreshIconPreview()
 	{
 		if (m_zoom >= 5.0f) {
-			if (m_previewLoader == nullptr) {
-				m_previewLoaderRunning = true;
-				m_previewLoader = new std::thread(&FileDialog::m_loadPreview, this);
+			if (m_previewThreads.empty()) {
+				size_t count = m_previewThreadCount;
+				if (count == 0)
+					count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MAX_PREVIEW_THREADS);
+				m_previewStop = false;
+				for (size_t i = 0; i < count; i++)
+					m_previewThreads.emplace_back(&FileDialog::m_previewWorker, this);
 			}
 		}
 		else
@@ -856,59 +1503,194 @@ namespace ifd {
 	}
 	void FileDialog::m_clearIconPreview()
 	{
-		m_stopPreviewLoader();
-
-		for (auto& data : m_content) {
-			if (!data.HasIconPreview)
-				continue;
-
-			data.HasIconPreview = false;
-			this->DeleteTexture(data.IconPreview);
-
-			if (data.IconPreviewData != nullptr) {
-				stbi_image_free(data.IconPreviewData);
-				data.IconPreviewData = nullptr;
-			}
+		// whatever the threads still finish belongs to the old generation and is dropped
+		{
+			std::lock_guard<std::mutex> lock(m_previewMutex);
+			m_previewGeneration++;
+			m_previewQueue.clear();
 		}
+		m_previewResults.Clear();
+		m_previewUploads.clear();
+		m_uploadWorstMs = 0;
+
+		for (auto& preview : m_previews)
+			if (preview.Texture != nullptr)
+				this->DeleteTexture(preview.Texture);
+		m_previews.assign(m_previews.size(), Preview());
+		m_previewCursor = 0;
+		m_previewsLoaded = 0;
+		m_previewStart = m_previewLast = std::chrono::steady_clock::time_point();
 	}
 	void FileDialog::m_stopPreviewLoader()
 	{
-		if (m_previewLoader != nullptr) {
-			m_previewLoaderRunning = false;
+		{
+			std::lock_guard<std::mutex> lock(m_previewMutex);
+			m_previewStop = true;
+		}
+		m_previewWake.notify_all();
+		for (auto& thread : m_previewThreads)
+			thread.join();
+		m_previewThreads.clear();
+	}
+	void FileDialog::m_previewWorker()
+	{
+		while (true) {
+			PreviewJob job;
+			unsigned int generation;
+			{
+				std::unique_lock<std::mutex> lock(m_previewMutex);
+				m_previewWake.wait(lock, [this] { return m_previewStop || !m_previewQueue.empty(); });
+				if (m_previewStop)
+					return;
+				job = std::move(m_previewQueue.front());
+				m_previewQueue.pop_front();
+				generation = m_previewGeneration;
+			}
 
-			if (m_previewLoader && m_previewLoader->joinable())
-				m_previewLoader->join();
+			// failures are handed back too, so the entry isn't asked for again
+			PreviewResult result{ job.Id, job.Serial, generation, PreviewImage() };
+			std::string path = u8StringToString(job.Path.u8string());
+			bool loaded = m_previewCache && m_previewCache->Find(path, job.Size, job.DateModified, result.Image);
+			if (!loaded && m_loadPreview(job.Path, result.Image)) {
+				loaded = true;
+				if (m_previewCache)
+					m_previewCache->Store(path, job.Size, job.DateModified, result.Image);
+			}
+			if (!loaded)
+				result.Image = PreviewImage();
 
-			delete m_previewLoader;
-			m_previewLoader = nullptr;
+			if (result.Generation == m_previewGeneration)
+				m_previewResults.Push(std::move(result));
 		}
 	}
-	void FileDialog::m_loadPreview()
+	bool FileDialog::m_loadPreview(const std::filesystem::path& path, PreviewImage& out)
 	{
-		for (size_t i = 0; m_previewLoaderRunning && i < m_content.size(); i++) {
-			auto& data = m_content[i];
+		if (LoadPreview && LoadPreview(path, PREVIEW_SIZE, out)) {
+			ScalePreview(out, PREVIEW_SIZE);
+			return true;
+		}
 
-			if (data.HasIconPreview)
-				continue;
+		if (!path.has_extension())
+			return false;
+		std::string ext = u8StringToString(path.extension().u8string());
+		if (ext != ".png" && ext != ".jpg" && ext != ".jpeg" && ext != ".bmp" && ext != ".tga")
+			return false;
 
-			if (data.Path.has_extension()) {
-				std::string ext = u8StringToString(data.Path.extension().u8string());
-				if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
-					int width, height, nrChannels;
-					unsigned char* image = stbi_load(u8StringToString(data.Path.u8string()).c_str(), &width, &height, &nrChannels, STBI_rgb_alpha);
+		int width, height, nrChannels;
+		unsigned char* image = stbi_load(u8StringToString(path.u8string()).c_str(), &width, &height, &nrChannels, STBI_rgb_alpha);
+		if (image == nullptr || width == 0 || height == 0) {
+			stbi_image_free(image);
+			return false;
+		}
 
-					if (image == nullptr || width == 0 || height == 0)
-						continue;
+		out.Data.assign(image, image + (size_t)width * height * 4);
+		out.Width = width;
+		out.Height = height;
+		stbi_image_free(image);
+		ScalePreview(out, PREVIEW_SIZE);
+		return true;
+	}
+	void FileDialog::m_requestPreviews(const std::vector<size_t>& visible)
+	{
+		bool queued = false;
+		{
+			std::lock_guard<std::mutex> lock(m_previewMutex);
+
+			// what is on screen goes to the front, in drawing order
+			for (auto it = visible.rbegin(); it != visible.rend(); ++it) {
+				const FileData& entry = m_content[m_filtered[*it]];
+				m_previews[entry.Id].Requested = true;
+				m_previewQueue.push_front(PreviewJob{ entry.Id, m_previews[entry.Id].Serial, entry.Path, entry.Size, entry.DateModified });
+				queued = true;
+			}
 
-					data.HasIconPreview = true;
-					data.IconPreviewData = image;
-					data.IconPreviewWidth = width;
-					data.IconPreviewHeight = height;
-				}
+			// keep the threads busy with the rest of the directory, but not so far
+			// ahead that newly visible entries wait behind it
+			while (m_previewQueue.size() < m_previewThreads.size() * 2 && m_previewCursor < m_filtered.size()) {
+				const FileData& entry = m_content[m_filtered[m_previewCursor++]];
+				if (entry.IsDirectory || m_previews[entry.Id].Requested)
+					continue;
+				m_previews[entry.Id].Requested = true;
+				m_previewQueue.push_back(PreviewJob{ entry.Id, m_previews[entry.Id].Serial, entry.Path, entry.Size, entry.DateModified });
+				queued = true;
 			}
 		}
 
-		m_previewLoaderRunning = false;
+		if (queued) {
+			if (m_previewStart == std::chrono::steady_clock::time_point())
+				m_previewStart = std::chrono::steady_clock::now();
+			m_previewWake.notify_all();
+		}
+	}
+	void FileDialog::m_applyPreviews()
+	{
+		m_previewResults.TakeAll(m_previewUploads);
+
+		// Creating a texture is an upload (and whatever else the driver does with
+		// it), so a folder whose previews all finish at once would stall the frame
+		// they land in. They are spread over frames within the upload budget.
+		auto start = std::chrono::steady_clock::now();
+		size_t bytes = 0;
+		bool first = true;
+		while (!m_previewUploads.empty()) {
+			PreviewResult& result = m_previewUploads.front();
+
+			// pushed after the previews were thrown away, or the slot was reset
+			// since it was requested because the file changed or went away
+			if (result.Generation != m_previewGeneration || result.Image.Width == 0 || result.Id >= m_previews.size() ||
+				result.Serial != m_previews[result.Id].Serial || !m_previews[result.Id].Requested) {
+				m_previewUploads.pop_front();
+				continue;
+			}
+
+			size_t size = result.Image.Data.size();
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (!first && (bytes + size > m_uploadBytesPerFrame || elapsed >= m_uploadMsPerFrame))
+				break;
+			first = false;
+			bytes += size;
+
+			Preview& preview = m_previews[result.Id];
+			preview.Texture = this->CreateTexture(result.Image.Data.data(), result.Image.Width, result.Image.Height, 1);
+			preview.Width = result.Image.Width;
+			preview.Height = result.Image.Height;
+			m_previewsLoaded++;
+			m_previewLast = std::chrono::steady_clock::now();
+			m_previewUploads.pop_front();
+		}
+		m_uploadWorstMs = std::max(m_uploadWorstMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	FileDialog::PreviewStats FileDialog::GetPreviewStats() const
+	{
+		PreviewStats stats;
+		stats.Loaded = m_previewsLoaded;
+		stats.Threads = m_previewThreads.size();
+		{
+			std::lock_guard<std::mutex> lock(m_previewMutex);
+			stats.Queued = m_previewQueue.size();
+		}
+		stats.Uploading = m_previewUploads.size();
+		stats.WorstUploadMs = m_uploadWorstMs;
+		double seconds = std::chrono::duration<double>(m_previewLast - m_previewStart).count();
+		if (m_previewsLoaded > 0 && seconds > 0.0)
+			stats.PerSecond = m_previewsLoaded / seconds;
+		if (m_previewCache) {
+			stats.CacheHits = m_previewCache->Hits;
+			stats.CacheMisses = m_previewCache->Misses;
+			stats.CacheBytes = m_previewCache->Bytes();
+		}
+		return stats;
+	}
+	void FileDialog::SetPreviewCache(const std::filesystem::path& directory, size_t maxBytes)
+	{
+		// the threads use the cache without locking the dialog
+		bool running = !m_previewThreads.empty();
+		m_stopPreviewLoader();
+		m_previewCache.reset();
+		if (!directory.empty() && maxBytes > 0)
+			m_previewCache = std::make_unique<PreviewCache>(directory, maxBytes);
+		if (running)
+			m_refreshIconPreview();
 	}
 	void FileDialog::m_clearTree(FileTreeNode* node)
 	{
@@ -935,13 +1717,19 @@ namespace ifd {
 			m_currentDirectory = std::filesystem::u8path(p.u8string() + u8"\\");
 #endif
 
+		m_cancelDirectoryJob();
+		m_stopWatching();
 		m_clearIconPreview();
 		m_content.clear(); // p == "" after this line, due to reference
+		m_filtered.clear();
 		m_selectedFileItem = -1;
+		m_selectedFilePath.clear();
+		m_directoryStart = std::chrono::steady_clock::now();
+		m_directoryFirstMs = m_directoryTotalMs = 0;
 
 		if (m_type == IFD_DIALOG_DIRECTORY || m_type == IFD_DIALOG_FILE)
 			m_inputTextbox[0] = 0;
-		m_selections.clear();
+		m_clearSelections();
 
 		if (!isSameDir) {
 			m_searchBuffer[0] = 0;
@@ -963,108 +1751,673 @@ namespace ifd {
 			}
 		}
 		else {
-			std::error_code ec;
-			if (std::filesystem::exists(m_currentDirectory, ec))
-				for (const auto& entry : std::filesystem::directory_iterator(m_currentDirectory, ec)) {
-					FileData info(entry.path());
+			// watch first, so nothing created while reading is missed
+			m_watchDirectory(m_currentDirectory);
+			m_directoryJob = std::make_shared<DirectoryJob>();
+			std::thread(&FileDialog::m_readDirectory, m_directoryJob, m_currentDirectory, m_type, m_currentExtensions()).detach();
+		}
 
-					// skip files when IFD_DIALOG_DIRECTORY
-					if (!info.IsDirectory && m_type == IFD_DIALOG_DIRECTORY)
-						continue;
+		for (size_t i = 0; i < m_content.size(); i++)
+			m_content[i].Id = i;
+		m_previews.assign(m_content.size(), Preview());
+		m_freeSlots.clear();
+		m_clearProbes();
 
-					// check if filename matches search query
-					if (m_searchBuffer[0]) {
-						std::string filename = u8StringToString(info.Path.u8string());
+		m_sortContent(m_sortColumn, m_sortDirection);
+		m_refreshIconPreview();
+	}
+	void FileDialog::m_readDirectory(std::shared_ptr<DirectoryJob> job, std::filesystem::path directory, uint8_t type,
+		std::vector<std::string> extensions)
+	{
+		// the first entry goes out on its own, then batches of up to 1024 or 16 ms
+		std::vector<FileData> batch;
+		bool first = true;
+		auto lastFlush = std::chrono::steady_clock::now();
+		auto flush = [&](bool done) {
+			std::lock_guard<std::mutex> lock(job->Mutex);
+			if (job->Ready.empty())
+				job->Ready.swap(batch);
+			else
+				std::move(batch.begin(), batch.end(), std::back_inserter(job->Ready));
+			job->Done = done;
+			batch.clear();
+			lastFlush = std::chrono::steady_clock::now();
+		};
 
-						std::string filenameSearch = filename;
-						std::string query(m_searchBuffer);
-						std::transform(filenameSearch.begin(), filenameSearch.end(), filenameSearch.begin(), ::tolower);
-						std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+		std::error_code ec;
+		if (std::filesystem::exists(directory, ec)) {
+			std::filesystem::directory_iterator it(directory, ec), end;
+			for (; !ec && it != end; it.increment(ec)) {
+				if (job->Cancelled)
+					return;
+
+				FileData info(it->path());
+				if (!m_acceptEntry(info, type, extensions))
+					continue;
 
-						if (filenameSearch.find(query, 0) == std::string::npos)
-							continue;
-					}
+				batch.push_back(std::move(info));
+				if (first || batch.size() >= 1024 || std::chrono::steady_clock::now() - lastFlush > std::chrono::milliseconds(16)) {
+					flush(false);
+					first = false;
+				}
+			}
+		}
+		flush(true);
+	}
+	bool FileDialog::m_acceptEntry(const FileData& info, uint8_t type, const std::vector<std::string>& extensions)
+	{
+		// skip files when IFD_DIALOG_DIRECTORY
+		if (!info.IsDirectory && type == IFD_DIALOG_DIRECTORY)
+			return false;
 
-					// check if extension matches
-					if (!info.IsDirectory && m_type != IFD_DIALOG_DIRECTORY) {
-						if (m_filterSelection < m_filterExtensions.size()) {
-							const auto& exts = m_filterExtensions[m_filterSelection];
-							if (exts.size() > 0) {
-								std::string extension = u8StringToString(info.Path.extension().u8string());
+		// check if extension matches
+		if (!info.IsDirectory && extensions.size() > 0) {
+			std::string extension = u8StringToString(info.Path.extension().u8string());
 
-								// extension not found? skip
-								if (std::count(exts.begin(), exts.end(), extension) == 0)
-									continue;
-							}
-						}
-					}
+			// extension not found? skip
+			if (std::count(extensions.begin(), extensions.end(), extension) == 0)
+				return false;
+		}
 
-					m_content.push_back(info);
-				}
+		return true;
+	}
+	std::vector<std::string> FileDialog::m_currentExtensions() const
+	{
+		if (m_type != IFD_DIALOG_DIRECTORY && m_filterSelection < m_filterExtensions.size())
+			return m_filterExtensions[m_filterSelection];
+		return std::vector<std::string>();
+	}
+	void FileDialog::m_cancelDirectoryJob()
+	{
+		if (m_directoryJob) {
+			m_directoryJob->Cancelled = true;
+			m_directoryJob.reset();
+		}
+	}
+	void FileDialog::SetProbeCache(const std::filesystem::path& directory)
+	{
+		// the threads use the cache without locking the dialog
+		m_stopProbes();
+		m_probeCache.reset();
+		if (!directory.empty())
+			m_probeCache = std::make_unique<ProbeCache>(directory);
+		m_clearProbes();
+	}
+	void FileDialog::m_clearProbes()
+	{
+		// whatever the threads still finish belongs to the old generation and is dropped
+		{
+			std::lock_guard<std::mutex> lock(m_probeMutex);
+			m_probeGeneration++;
+			m_probeQueue.clear();
 		}
+		m_probeResults.Clear();
+		m_probes.assign(m_previews.size(), Probe());
+		m_probesMoved.clear();
+	}
+	void FileDialog::m_stopProbes()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_probeMutex);
+			m_probeStop = true;
+		}
+		m_probeWake.notify_all();
+		for (auto& thread : m_probeThreads)
+			thread.join();
+		m_probeThreads.clear();
+		m_probeStop = false;
+	}
+	void FileDialog::m_probeWorker()
+	{
+		while (true) {
+			PreviewJob job;
+			unsigned int generation;
+			{
+				std::unique_lock<std::mutex> lock(m_probeMutex);
+				m_probeWake.wait(lock, [this] { return m_probeStop || !m_probeQueue.empty(); });
+				if (m_probeStop)
+					return;
+				job = std::move(m_probeQueue.front());
+				m_probeQueue.pop_front();
+				generation = m_probeGeneration;
+			}
 
-		m_sortContent(m_sortColumn, m_sortDirection);
-		m_refreshIconPreview();
+			// failures are handed back too, so the row isn't asked for again
+			ProbeResult result{ job.Id, job.Serial, generation, false, MediaInfo() };
+			std::string path = u8StringToString(job.Path.u8string());
+			result.Probed = m_probeCache && m_probeCache->Find(path, job.Size, job.DateModified, result.Info);
+			if (!result.Probed && ProbeMedia(job.Path, result.Info)) {
+				result.Probed = true;
+				if (m_probeCache)
+					m_probeCache->Store(path, job.Size, job.DateModified, result.Info);
+			}
+
+			if (result.Generation == m_probeGeneration)
+				m_probeResults.Push(std::move(result));
+		}
 	}
-	void FileDialog::m_sortContent(unsigned int column, unsigned int sortDirection)
+	void FileDialog::m_requestProbes(const std::vector<size_t>& visible)
 	{
-		// 0 -> name, 1 -> date, 2 -> size
-		m_sortColumn = column;
-		m_sortDirection = sortDirection;
+		std::unordered_set<size_t> onScreen;
+		for (size_t row : visible)
+			onScreen.insert(m_content[m_filtered[row]].Id);
 
-		// split into directories and files
-		std::partition(m_content.begin(), m_content.end(), [](const FileData& data) {
-			return data.IsDirectory;
-			});
+		bool queued = false;
+		{
+			std::lock_guard<std::mutex> lock(m_probeMutex);
+			// rows scrolled off screen before their turn aren't probed; they are
+			// asked for again if they come back
+			m_probeQueue.erase(std::remove_if(m_probeQueue.begin(), m_probeQueue.end(), [&](const PreviewJob& job) {
+				if (onScreen.count(job.Id))
+					return false;
+				m_probes[job.Id].Requested = false;
+				return true;
+			}), m_probeQueue.end());
+
+			for (auto it = visible.rbegin(); it != visible.rend(); ++it) {
+				const FileData& entry = m_content[m_filtered[*it]];
+				if (m_probes[entry.Id].Requested)
+					continue;
+				m_probes[entry.Id].Requested = true;
+				m_probeQueue.push_front(PreviewJob{ entry.Id, m_probes[entry.Id].Serial, entry.Path, entry.Size, entry.DateModified });
+				queued = true;
+			}
+		}
+		if (!queued)
+			return;
 
-		if (m_content.size() > 0) {
-			// find where the file list starts
-			size_t fileIndex = 0;
-			for (; fileIndex < m_content.size(); fileIndex++)
-				if (!m_content[fileIndex].IsDirectory)
-					break;
+		if (m_probeThreads.empty())
+			for (size_t i = 0; i < PROBE_THREADS; i++)
+				m_probeThreads.emplace_back(&FileDialog::m_probeWorker, this);
+		m_probeWake.notify_all();
+	}
+	void FileDialog::m_applyProbes()
+	{
+		std::vector<ProbeResult> results;
+		m_probeResults.TakeAll(results);
 
-			// compare function
-			auto compareFn = [column, sortDirection](const FileData& left, const FileData& right) -> bool {
-				// name
-				if (column == 0) {
-					std::string lName = u8StringToString(left.Path.u8string());
-					std::string rName = u8StringToString(right.Path.u8string());
+		char buffer[64];
+		for (auto& result : results) {
+			if (result.Generation != m_probeGeneration || result.Id >= m_probes.size() || result.Serial != m_probes[result.Id].Serial ||
+				!m_probes[result.Id].Requested)
+				continue;
 
-					std::transform(lName.begin(), lName.end(), lName.begin(), ::tolower);
-					std::transform(rName.begin(), rName.end(), rName.begin(), ::tolower);
+			Probe& probe = m_probes[result.Id];
+			probe.Done = true;
+			if (!result.Probed)
+				continue;
+			probe.Info = std::move(result.Info);
+			if (probe.Info.Duration > 0) {
+				int seconds = (int)probe.Info.Duration;
+				snprintf(buffer, sizeof(buffer), "%d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+				probe.DurationString = buffer;
+			}
+			if (probe.Info.Width > 0) {
+				snprintf(buffer, sizeof(buffer), "%dx%d", probe.Info.Width, probe.Info.Height);
+				probe.ResolutionString = buffer;
+			}
+			if (probe.Info.FrameRate > 0) {
+				snprintf(buffer, sizeof(buffer), "%.3g", probe.Info.FrameRate);
+				probe.FrameRateString = buffer;
+			}
+			if (m_sortColumn >= 3)
+				m_probesMoved.insert(result.Id);
+		}
 
-					int comp = lName.compare(rName);
+		// rows sorted by a probed column move as results arrive, a few times a
+		// second; only those rows are taken out and put back in place. A
+		// directory still loading isn't sorted yet, it is once it is complete.
+		auto now = std::chrono::steady_clock::now();
+		if (!m_probesMoved.empty() && !m_directoryJob && now - m_probesSorted > std::chrono::milliseconds(250)) {
+			m_resortEntries(m_probesMoved);
+			m_probesMoved.clear();
+			m_probesSorted = now;
+		}
+	}
+	void FileDialog::m_watchDirectory(const std::filesystem::path& directory)
+	{
+		m_stopWatching();
+#ifdef __linux__
+		m_watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_watchFd < 0)
+			return;
 
-					if (sortDirection == ImGuiSortDirection_Ascending)
-						return comp < 0;
-					return comp > 0;
-				}
-				// date
-				else if (column == 1) {
-					if (sortDirection == ImGuiSortDirection_Ascending)
-						return left.DateModified < right.DateModified;
-					else
-						return left.DateModified > right.DateModified;
-				}
-				// size
-				else if (column == 2) {
-					if (sortDirection == ImGuiSortDirection_Ascending)
-						return left.Size < right.Size;
+		// IN_CLOSE_WRITE rather than IN_MODIFY: a file being written counts once, when it is done
+		if (inotify_add_watch(m_watchFd, directory.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+			IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR) < 0)
+			m_stopWatching();
+#endif
+	}
+	void FileDialog::m_stopWatching()
+	{
+#ifdef __linux__
+		// closing drops the watch and whatever events were still queued
+		if (m_watchFd >= 0)
+			close(m_watchFd);
+#endif
+		m_watchFd = -1;
+		m_watchChanged.clear();
+		m_watchOverflow = false;
+		m_watchFirst = std::chrono::steady_clock::time_point();
+	}
+	void FileDialog::m_pollWatcher()
+	{
+#ifdef __linux__
+		if (m_watchFd < 0)
+			return;
+
+		auto now = std::chrono::steady_clock::now();
+		alignas(struct inotify_event) char buffer[16 * 1024];
+		ssize_t length;
+		while ((length = read(m_watchFd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length; ) {
+				const struct inotify_event* event = (const struct inotify_event*)ptr;
+				if (event->mask & IN_Q_OVERFLOW)
+					m_watchOverflow = true;
+				else if (event->len > 0)
+					m_watchChanged.insert(event->name);
+				ptr += sizeof(struct inotify_event) + event->len;
+			}
+			if (m_watchFirst == std::chrono::steady_clock::time_point())
+				m_watchFirst = now;
+			m_watchLast = now;
+		}
+
+		// wait for the burst to settle, and for the directory to be read
+		if (m_watchFirst == std::chrono::steady_clock::time_point() || m_directoryJob)
+			return;
+		if (now - m_watchLast < std::chrono::milliseconds(100) && now - m_watchFirst < std::chrono::seconds(1))
+			return;
+
+		m_watchFirst = std::chrono::steady_clock::time_point();
+		m_applyWatchedChanges();
+#endif
+	}
+	void FileDialog::m_applyWatchedChanges()
+	{
+		// events were lost, nothing left to do but read it all again
+		if (m_watchOverflow) {
+			m_setDirectory(m_currentDirectory, false);
+			return;
+		}
+
+		std::vector<std::string> extensions = m_currentExtensions();
+		std::unordered_map<std::string, size_t> positions;
+		positions.reserve(m_content.size());
+		for (size_t i = 0; i < m_content.size(); i++)
+			positions[m_content[i].DisplayName] = i;
+
+		// changed files are taken out and put back in order, like new ones
+		std::vector<size_t> taken;
+		std::vector<FileData> placed;
+		for (const std::string& name : m_watchChanged) {
+			std::filesystem::path path = m_currentDirectory / std::filesystem::u8path(name);
+			auto found = positions.find(name);
+
+			std::error_code ec;
+			bool keep = false;
+			if (std::filesystem::exists(path, ec)) {
+				FileData info(path);
+				keep = m_acceptEntry(info, m_type, extensions);
+				if (keep) {
+					if (found != positions.end()) {
+						// same slot, reset so a thumbnail of the old contents still being made is dropped
+						info.Id = m_content[found->second].Id;
+						m_resetSlot(info.Id);
+						taken.push_back(found->second);
+					}
 					else
-						return left.Size > right.Size;
+						info.Id = m_allocateSlot();
+					placed.push_back(std::move(info));
 				}
+			}
+			if (!keep && found != positions.end()) {
+				m_resetSlot(m_content[found->second].Id);
+				m_freeSlots.push_back(m_content[found->second].Id);
+				taken.push_back(found->second);
+				if (m_selectionSet.erase(path))
+					m_selections.erase(std::find(m_selections.begin(), m_selections.end(), path));
+			}
+		}
+		m_watchChanged.clear();
 
-				return false;
-			};
+		std::sort(taken.begin(), taken.end());
+		m_takeEntries(taken);
+		m_insertSorted(std::move(placed));
+	}
+	size_t FileDialog::m_allocateSlot()
+	{
+		if (!m_freeSlots.empty()) {
+			size_t id = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			return id;
+		}
+		m_previews.emplace_back();
+		m_probes.emplace_back();
+		return m_previews.size() - 1;
+	}
+	void FileDialog::m_resetSlot(size_t id)
+	{
+		if (id >= m_previews.size())
+			return;
+		Preview& preview = m_previews[id];
+		if (preview.Texture != nullptr)
+			this->DeleteTexture(preview.Texture);
+		preview = Preview{ nullptr, 0, 0, false, preview.Serial + 1 };
+
+		if (id < m_probes.size()) {
+			unsigned int serial = m_probes[id].Serial + 1;
+			m_probes[id] = Probe();
+			m_probes[id].Serial = serial;
+		}
+		m_probesMoved.erase(id);
+	}
+	void FileDialog::m_pollDirectoryJob()
+	{
+		if (!m_directoryJob)
+			return;
+
+		std::vector<FileData> ready;
+		bool done;
+		{
+			std::lock_guard<std::mutex> lock(m_directoryJob->Mutex);
+			ready.swap(m_directoryJob->Ready);
+			done = m_directoryJob->Done;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (!ready.empty()) {
+			if (m_content.empty())
+				m_directoryFirstMs = std::chrono::duration<double, std::milli>(now - m_directoryStart).count();
+
+			m_content.reserve(m_content.size() + ready.size());
+			for (auto& entry : ready) {
+				entry.Id = m_content.size();
+				if (m_matches(entry))
+					m_filtered.push_back(m_content.size());
+				m_content.push_back(std::move(entry));
+			}
+			m_previews.resize(m_content.size());
+			m_probes.resize(m_content.size());
+		}
+
+		// new entries show up at the end in the order they were read; sorting
+		// the growing list over and over would stall the UI on big directories,
+		// so it is sorted once, when it is complete
+		if (done)
+			m_sortContent(m_sortColumn, m_sortDirection, true);
+
+		m_directoryTotalMs = std::chrono::duration<double, std::milli>(now - m_directoryStart).count();
+		if (done)
+			m_directoryJob.reset();
+	}
+	FileDialog::DirectoryStats FileDialog::GetDirectoryStats() const
+	{
+		DirectoryStats stats;
+		stats.Entries = m_content.size();
+		stats.Matches = m_filtered.size();
+		stats.SearchMs = m_searchMs;
+		stats.FirstEntryMs = m_directoryFirstMs;
+		stats.TotalMs = m_directoryTotalMs;
+		stats.Loading = m_directoryJob != nullptr;
+		return stats;
+	}
+	// true if every character of `query` appears in `name` in the same order
+	static bool IsSubsequence(const std::string& query, const std::string& name)
+	{
+		size_t i = 0;
+		for (size_t j = 0; i < query.size() && j < name.size(); j++)
+			if (name[j] == query[i])
+				i++;
+		return i == query.size();
+	}
+	bool FileDialog::m_matches(const FileData& entry) const
+	{
+		if (m_filteredQuery.empty())
+			return true;
+		if (m_filteredFuzzy)
+			return IsSubsequence(m_filteredQuery, entry.SearchName);
+		return entry.SearchName.find(m_filteredQuery) != std::string::npos;
+	}
+	void FileDialog::m_search(bool narrow)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		std::string query(m_searchBuffer);
+		std::transform(query.begin(), query.end(), query.begin(), ::tolower);
+
+		// a query that contains the last one can only match a subset of its result
+		narrow = narrow && m_filteredFuzzy == m_fuzzySearch && !m_filteredQuery.empty() &&
+			(m_fuzzySearch ? IsSubsequence(m_filteredQuery, query) : query.find(m_filteredQuery) != std::string::npos);
+		m_filteredQuery = query;
+		m_filteredFuzzy = m_fuzzySearch;
+
+		if (narrow) {
+			m_filtered.erase(std::remove_if(m_filtered.begin(), m_filtered.end(), [this](size_t position) {
+				return !m_matches(m_content[position]);
+			}), m_filtered.end());
+		}
+		else {
+			m_filtered.clear();
+			m_filtered.reserve(m_content.size());
+			for (size_t i = 0; i < m_content.size(); i++)
+				if (m_matches(m_content[i]))
+					m_filtered.push_back(i);
+		}
+
+		m_previewCursor = 0;
+		m_searchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	// Compares folded names with runs of digits taken as numbers, so that
+	// "clip2" comes before "clip10". Equal numbers with more leading zeros
+	// go after, which keeps the order total.
+	static int NaturalCompare(const std::string& left, const std::string& right)
+	{
+		size_t i = 0, j = 0;
+		int zeros = 0;
+		while (i < left.size() && j < right.size()) {
+			bool lDigit = isdigit((unsigned char)left[i]), rDigit = isdigit((unsigned char)right[j]);
+			if (lDigit && rDigit) {
+				size_t lStart = i, rStart = j;
+				while (i < left.size() && left[i] == '0') i++;
+				while (j < right.size() && right[j] == '0') j++;
+				size_t lDigits = i, rDigits = j;
+				while (i < left.size() && isdigit((unsigned char)left[i])) i++;
+				while (j < right.size() && isdigit((unsigned char)right[j])) j++;
+
+				// more significant digits is the bigger number, else compare them in order
+				if (i - lDigits != j - rDigits)
+					return i - lDigits < j - rDigits ? -1 : 1;
+				int comp = left.compare(lDigits, i - lDigits, right, rDigits, j - rDigits);
+				if (comp != 0)
+					return comp;
+				if (zeros == 0 && lDigits - lStart != rDigits - rStart)
+					zeros = lDigits - lStart < rDigits - rStart ? -1 : 1;
+			}
+			else {
+				if (left[i] != right[j])
+					return (unsigned char)left[i] < (unsigned char)right[j] ? -1 : 1;
+				i++;
+				j++;
+			}
+		}
+		if (i < left.size()) return 1;
+		if (j < right.size()) return -1;
+		return zeros;
+	}
+	// Sort small keys instead of moving FileData around; the name is only
+	// looked at for the name column and to break ties.
+	struct SortKey {
+		const std::string* Name;
+		const std::string* Text; // codec, compared before the name
+		uint64_t Value;          // date, size, duration, pixels or frame rate
+		uint32_t Index;
+		bool IsDirectory;
+	};
+	static SortKey MakeSortKey(const FileDialog::FileData& entry, const FileDialog::MediaInfo* info, unsigned int column, uint32_t index)
+	{
+		// 0 -> name, 1 -> date, 2 -> size, 3 -> duration, 4 -> resolution, 5 -> codec, 6 -> fps
+		static const std::string none;
+		uint64_t value = 0;
+		if (column == 1)
+			value = (uint64_t)entry.DateModified;
+		else if (column == 2)
+			value = (uint64_t)entry.Size;
+		else if (column == 3 && info)
+			value = (uint64_t)(info->Duration * 1000);
+		else if (column == 4 && info)
+			value = (uint64_t)info->Width * info->Height;
+		else if (column == 6 && info)
+			value = (uint64_t)(info->FrameRate * 1000);
+		return { &entry.SearchName, column == 5 && info ? &info->Codec : &none, value, index, entry.IsDirectory };
+	}
+	// directories first, then the column, then the name; the index makes the
+	// order total, so sorting is stable and independent of how it is split up
+	static bool SortKeyLess(const SortKey& left, const SortKey& right, bool descending)
+	{
+		if (left.IsDirectory != right.IsDirectory)
+			return left.IsDirectory;
+		const SortKey& a = descending ? right : left;
+		const SortKey& b = descending ? left : right;
+		if (a.Value != b.Value)
+			return a.Value < b.Value;
+		int comp = a.Text->compare(*b.Text);
+		if (comp != 0)
+			return comp < 0;
+		comp = NaturalCompare(*a.Name, *b.Name);
+		if (comp != 0)
+			return comp < 0;
+		return left.Index < right.Index;
+	}
+	const FileDialog::MediaInfo* FileDialog::m_sortInfo(const FileData& entry) const
+	{
+		return m_sortColumn >= 3 && entry.Id < m_probes.size() ? &m_probes[entry.Id].Info : nullptr;
+	}
+	bool FileDialog::m_sortLess(const FileData& left, const FileData& right) const
+	{
+		return SortKeyLess(MakeSortKey(left, m_sortInfo(left), m_sortColumn, 0), MakeSortKey(right, m_sortInfo(right), m_sortColumn, 0),
+			m_sortDirection != ImGuiSortDirection_Ascending);
+	}
+	void FileDialog::m_sortContent(unsigned int column, unsigned int sortDirection, bool parallel)
+	{
+		m_sortColumn = column;
+		m_sortDirection = sortDirection;
+		m_previewCursor = 0; // prefetch in the new order
+		m_probesMoved.clear();
+
+		std::vector<SortKey> keys(m_content.size());
+		for (size_t i = 0; i < m_content.size(); i++)
+			keys[i] = MakeSortKey(m_content[i], m_sortInfo(m_content[i]), column, (uint32_t)i);
+
+		bool descending = sortDirection != ImGuiSortDirection_Ascending;
+		auto compareFn = [descending](const SortKey& left, const SortKey& right) -> bool {
+			return SortKeyLess(left, right, descending);
+		};
+
+		// large directories: sort slices on their own threads, then merge them
+		size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 8);
+		if (!parallel || keys.size() < PARALLEL_SORT_MIN || threads < 2)
+			std::sort(keys.begin(), keys.end(), compareFn);
+		else {
+			std::vector<size_t> bounds;
+			for (size_t i = 0; i <= threads; i++)
+				bounds.push_back(keys.size() * i / threads);
+
+			std::vector<std::thread> workers;
+			for (size_t i = 1; i < threads; i++)
+				workers.emplace_back([&keys, &bounds, &compareFn, i]() {
+					std::sort(keys.begin() + bounds[i], keys.begin() + bounds[i + 1], compareFn);
+				});
+			std::sort(keys.begin(), keys.begin() + bounds[1], compareFn);
+			for (auto& worker : workers)
+				worker.join();
+
+			for (size_t width = 1; width < threads; width *= 2)
+				for (size_t i = 0; i + width < threads; i += width * 2)
+					std::inplace_merge(keys.begin() + bounds[i], keys.begin() + bounds[i + width],
+						keys.begin() + bounds[std::min(i + width * 2, threads)], compareFn);
+		}
+
+		std::vector<FileData> sorted;
+		sorted.reserve(m_content.size());
+		for (const SortKey& key : keys)
+			sorted.push_back(std::move(m_content[key.Index]));
+		m_content.swap(sorted);
+
+		// positions moved, filter again
+		m_search(false);
+	}
+	std::vector<FileDialog::FileData> FileDialog::m_takeEntries(const std::vector<size_t>& positions)
+	{
+		std::vector<FileData> taken;
+		if (positions.empty())
+			return taken;
+		taken.reserve(positions.size());
+
+		size_t count = 0, next = 0;
+		for (size_t i = 0; i < m_content.size(); i++) {
+			if (next < positions.size() && positions[next] == i) {
+				taken.push_back(std::move(m_content[i]));
+				next++;
+				continue;
+			}
+			if (count != i)
+				m_content[count] = std::move(m_content[i]);
+			count++;
+		}
+		m_content.erase(m_content.begin() + count, m_content.end());
+
+		// everything after a taken entry moves up by one per taken entry before it
+		size_t kept = 0;
+		for (size_t position : m_filtered) {
+			auto before = std::lower_bound(positions.begin(), positions.end(), position);
+			if (before != positions.end() && *before == position)
+				continue;
+			m_filtered[kept++] = position - (before - positions.begin());
+		}
+		m_filtered.resize(kept);
+		m_selectedFileItem = -1;
+		return taken;
+	}
+	void FileDialog::m_insertSorted(std::vector<FileData> entries)
+	{
+		if (entries.empty())
+			return;
+		auto less = [this](const FileData& left, const FileData& right) { return m_sortLess(left, right); };
+		m_previewCursor = 0;
+		m_selectedFileItem = -1;
 
-			// sort the directories
-			std::sort(m_content.begin(), m_content.begin() + fileIndex, compareFn);
+		// every insert shifts the entries behind it, so past a few one merge is cheaper
+		if (entries.size() > INSERT_SORTED_MAX) {
+			std::sort(entries.begin(), entries.end(), less);
+			size_t middle = m_content.size();
+			m_content.reserve(middle + entries.size());
+			std::move(entries.begin(), entries.end(), std::back_inserter(m_content));
+			std::inplace_merge(m_content.begin(), m_content.begin() + middle, m_content.end(), less);
+			m_search(false);
+			return;
+		}
 
-			// sort the files
-			std::sort(m_content.begin() + fileIndex, m_content.end(), compareFn);
+		for (FileData& entry : entries) {
+			size_t position = std::upper_bound(m_content.begin(), m_content.end(), entry, less) - m_content.begin();
+			bool match = m_matches(entry);
+			m_content.insert(m_content.begin() + position, std::move(entry));
+
+			auto after = std::lower_bound(m_filtered.begin(), m_filtered.end(), position);
+			for (auto it = after; it != m_filtered.end(); ++it)
+				(*it)++;
+			if (match)
+				m_filtered.insert(after, position);
 		}
 	}
+	void FileDialog::m_resortEntries(const std::unordered_set<size_t>& ids)
+	{
+		std::vector<size_t> positions;
+		for (size_t i = 0; i < m_content.size(); i++)
+			if (ids.count(m_content[i].Id))
+				positions.push_back(i);
+		m_insertSorted(m_takeEntries(positions));
+	}
 
 	void FileDialog::m_renderTree(FileTreeNode* node)
 	{
@@ -1101,13 +2454,27 @@ namespace ifd {
 		if (ImGui::IsMouseClicked(ImGuiMouseButton_Right))
 			m_selectedFileItem = -1;
 
+		if (m_directoryJob)
+			ImGui::TextDisabled("Reading directory... %zu entries", m_content.size());
+
 		// table view
 		if (m_zoom == 1.0f) {
-			if (ImGui::BeginTable("##contentTable", 3, /*ImGuiTableFlags_Resizable |*/ ImGuiTableFlags_Sortable, ImVec2(0, -FLT_MIN))) {
+			const bool probes = (bool)ProbeMedia;
+			if (probes)
+				m_applyProbes();
+			std::vector<size_t> probeRows;
+
+			if (ImGui::BeginTable("##contentTable", probes ? 7 : 3, /*ImGuiTableFlags_Resizable |*/ ImGuiTableFlags_Sortable, ImVec2(0, -FLT_MIN))) {
 				// header
 				ImGui::TableSetupColumn("Name##filename", ImGuiTableColumnFlags_WidthStretch, 0.0f - 1.0f, 0);
 				ImGui::TableSetupColumn("Date modified##filedate", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 1);
 				ImGui::TableSetupColumn("Size##filesize", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 2);
+				if (probes) {
+					ImGui::TableSetupColumn("Duration##fileduration", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 3);
+					ImGui::TableSetupColumn("Resolution##fileresolution", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 4);
+					ImGui::TableSetupColumn("Codec##filecodec", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 5);
+					ImGui::TableSetupColumn("FPS##filefps", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize, 0.0f, 6);
+				}
 				ImGui::TableSetupScrollFreeze(0, 1);
 				ImGui::TableHeadersRow();
 
@@ -1115,99 +2482,131 @@ namespace ifd {
 				if (ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs()) {
 					if (sortSpecs->SpecsDirty) {
 						sortSpecs->SpecsDirty = false;
-						m_sortContent(sortSpecs->Specs->ColumnUserID, sortSpecs->Specs->SortDirection);
+						m_sortContent(sortSpecs->Specs->ColumnUserID, sortSpecs->Specs->SortDirection, true);
 					}
 				}
 
-				// content
-				int fileId = 0;
-				for (auto& entry : m_content) {
-					std::string filename = u8StringToString(entry.Path.filename().u8string());
-					if (filename.size() == 0)
-						filename = u8StringToString(entry.Path.u8string()); // drive
-
-					bool isSelected = std::count(m_selections.begin(), m_selections.end(), entry.Path);
-
-					ImGui::TableNextRow();
-
-					// file name
-					ImGui::TableSetColumnIndex(0);
-					ImGui::Image((ImTextureID)m_getIcon(entry.Path), ImVec2(ICON_SIZE, ICON_SIZE));
-					ImGui::SameLine();
-					if (ImGui::Selectable(filename.c_str(), isSelected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick)) {
-						std::error_code ec;
-						bool isDir = std::filesystem::is_directory(entry.Path, ec);
-
-						if (ImGui::IsMouseDoubleClicked(0)) {
-							if (isDir) {
-								m_setDirectory(entry.Path);
-								break;
+				// content, only the rows that are on screen
+				bool changedDirectory = false;
+				ImGuiListClipper clipper;
+				clipper.Begin(static_cast<int>(m_filtered.size()));
+				while (!changedDirectory && clipper.Step()) {
+					for (int fileId = clipper.DisplayStart; fileId < clipper.DisplayEnd; fileId++) {
+						auto& entry = m_content[m_filtered[fileId]];
+						bool isSelected = m_selectionSet.count(entry.Path) != 0;
+
+						ImGui::TableNextRow();
+
+						// file name
+						ImGui::TableSetColumnIndex(0);
+						ImGui::Image((ImTextureID)m_getIcon(entry), ImVec2(ICON_SIZE, ICON_SIZE));
+						ImGui::SameLine();
+						if (ImGui::Selectable(entry.DisplayName.c_str(), isSelected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick)) {
+							if (ImGui::IsMouseDoubleClicked(0)) {
+								if (entry.IsDirectory) {
+									m_setDirectory(entry.Path);
+									changedDirectory = true;
+									break;
+								}
+								else
+									m_finalize(entry.DisplayName);
 							}
-							else
-								m_finalize(filename);
+							else {
+								if ((entry.IsDirectory && m_type == IFD_DIALOG_DIRECTORY) || !entry.IsDirectory)
+									m_select(entry.Path, ImGui::GetIO().KeyCtrl);
+							}
+						}
+						if (ImGui::IsItemClicked(ImGuiMouseButton_Right)) {
+							m_selectedFileItem = fileId;
+							m_selectedFilePath = entry.Path;
 						}
-						else {
-							if ((isDir && m_type == IFD_DIALOG_DIRECTORY) || !isDir)
-								m_select(entry.Path, ImGui::GetIO().KeyCtrl);
+
+						// date
+						ImGui::TableSetColumnIndex(1);
+						ImGui::TextUnformatted(entry.DateString.c_str());
+
+						// size
+						ImGui::TableSetColumnIndex(2);
+						ImGui::TextUnformatted(entry.SizeString.c_str());
+
+						// media, blank until probed
+						if (probes && !entry.IsDirectory && entry.Id < m_probes.size()) {
+							const Probe& probe = m_probes[entry.Id];
+							probeRows.push_back(fileId);
+							ImGui::TableSetColumnIndex(3);
+							ImGui::TextUnformatted(probe.DurationString.c_str());
+							ImGui::TableSetColumnIndex(4);
+							ImGui::TextUnformatted(probe.ResolutionString.c_str());
+							ImGui::TableSetColumnIndex(5);
+							ImGui::TextUnformatted(probe.Info.Codec.c_str());
+							ImGui::TableSetColumnIndex(6);
+							ImGui::TextUnformatted(probe.FrameRateString.c_str());
 						}
 					}
-					if (ImGui::IsItemClicked(ImGuiMouseButton_Right))
-						m_selectedFileItem = fileId;
-					fileId++;
-
-					// date
-					ImGui::TableSetColumnIndex(1);
-					auto tm = std::localtime(&entry.DateModified);
-					if (tm != nullptr)
-						ImGui::Text("%d/%d/%d %02d:%02d", tm->tm_mon + 1, tm->tm_mday, 1900 + tm->tm_year, tm->tm_hour, tm->tm_min);
-					else ImGui::Text("---");
-
-					// size
-					ImGui::TableSetColumnIndex(2);
-					ImGui::Text("%.3f KiB", entry.Size / 1024.0f);
 				}
+				if (changedDirectory)
+					clipper.End();
+				else if (probes)
+					m_requestProbes(probeRows);
 
 				ImGui::EndTable();
 			}
 		}
 		// "icon" view
 		else {
-			// content
-			int fileId = 0;
-			for (auto& entry : m_content) {
-				if (entry.HasIconPreview && entry.IconPreviewData != nullptr) {
-					entry.IconPreview = this->CreateTexture(entry.IconPreviewData, entry.IconPreviewWidth, entry.IconPreviewHeight, 1);
-					stbi_image_free(entry.IconPreviewData);
-					entry.IconPreviewData = nullptr;
-				}
-
-				std::string filename = u8StringToString(entry.Path.filename().u8string());
-				if (filename.size() == 0)
-					filename = u8StringToString(entry.Path.u8string()); // drive
-
-				bool isSelected = std::count(m_selections.begin(), m_selections.end(), entry.Path);
-
-				if (FileIcon(filename.c_str(), isSelected, entry.HasIconPreview ? entry.IconPreview : (ImTextureID)m_getIcon(entry.Path), ImVec2(32 + 16 * m_zoom, 32 + 16 * m_zoom), entry.HasIconPreview, entry.IconPreviewWidth, entry.IconPreviewHeight)) {
-					std::error_code ec;
-					bool isDir = std::filesystem::is_directory(entry.Path, ec);
-
-					if (ImGui::IsMouseDoubleClicked(0)) {
-						if (isDir) {
-							m_setDirectory(entry.Path);
-							break;
+			m_applyPreviews();
+			const bool previews = !m_previewThreads.empty();
+			std::vector<size_t> visible;
+
+			// content, laid out in rows of equal height so only the visible rows are submitted
+			ImVec2 iconSize(32 + 16 * m_zoom, 32 + 16 * m_zoom);
+			float spacing = ImGui::GetStyle().ItemSpacing.x;
+			int columns = std::max(1, static_cast<int>((ImGui::GetContentRegionAvail().x + spacing) / (iconSize.x + spacing)));
+			int rows = static_cast<int>((m_filtered.size() + columns - 1) / columns);
+
+			bool changedDirectory = false;
+			ImGuiListClipper clipper;
+			clipper.Begin(rows, iconSize.y + ImGui::GetStyle().ItemSpacing.y);
+			while (!changedDirectory && clipper.Step()) {
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd && !changedDirectory; row++) {
+					int rowEnd = std::min(static_cast<int>(m_filtered.size()), (row + 1) * columns);
+					for (int fileId = row * columns; fileId < rowEnd; fileId++) {
+						auto& entry = m_content[m_filtered[fileId]];
+						const Preview& preview = m_previews[entry.Id];
+						bool hasPreview = preview.Texture != nullptr;
+						bool isSelected = m_selectionSet.count(entry.Path) != 0;
+
+						if (fileId != row * columns)
+							ImGui::SameLine();
+						if (FileIcon(entry.DisplayName.c_str(), isSelected, hasPreview ? preview.Texture : (ImTextureID)m_getIcon(entry), iconSize, hasPreview, preview.Width, preview.Height)) {
+							if (ImGui::IsMouseDoubleClicked(0)) {
+								if (entry.IsDirectory) {
+									m_setDirectory(entry.Path);
+									changedDirectory = true;
+									break;
+								}
+								else
+									m_finalize(entry.DisplayName);
+							}
+							else {
+								if ((entry.IsDirectory && m_type == IFD_DIALOG_DIRECTORY) || !entry.IsDirectory)
+									m_select(entry.Path, ImGui::GetIO().KeyCtrl);
+							}
 						}
-						else
-							m_finalize(filename);
-					}
-					else {
-						if ((isDir && m_type == IFD_DIALOG_DIRECTORY) || !isDir)
-							m_select(entry.Path, ImGui::GetIO().KeyCtrl);
+						if (ImGui::IsItemClicked(ImGuiMouseButton_Right)) {
+							m_selectedFileItem = fileId;
+							m_selectedFilePath = entry.Path;
+						}
+						if (previews && !preview.Requested && !entry.IsDirectory)
+							visible.push_back(fileId);
 					}
 				}
-				if (ImGui::IsItemClicked(ImGuiMouseButton_Right))
-					m_selectedFileItem = fileId;
-				fileId++;
 			}
+			if (changedDirectory)
+				clipper.End();
+
+			if (previews && !changedDirectory)
+				m_requestPreviews(visible);
 		}
 	}
 	void FileDialog::m_renderPopups()
@@ -1229,14 +2628,14 @@ namespace ifd {
 		if (openNewDirectoryDlg)
 			ImGui::OpenPopup("Enter directory name##newdir");
 		if (ImGui::BeginPopupModal("Are you sure?##delete")) {
-			if (m_selectedFileItem >= static_cast<int>(m_content.size()) || m_content.size() == 0)
+			// by path: the list can be sorted again while the popup is open
+			if (m_selectedFilePath.empty())
 				ImGui::CloseCurrentPopup();
 			else {
-				const FileData& data = m_content[m_selectedFileItem];
-				ImGui::TextWrapped("Are you sure you want to delete %s?", u8StringToString(data.Path.filename().u8string()).c_str());
+				ImGui::TextWrapped("Are you sure you want to delete %s?", u8StringToString(m_selectedFilePath.filename().u8string()).c_str());
 				if (ImGui::Button("Yes")) {
 					std::error_code ec;
-					std::filesystem::remove_all(data.Path, ec);
+					std::filesystem::remove_all(m_selectedFilePath, ec);
 					m_setDirectory(m_currentDirectory, false); // refresh
 					ImGui::CloseCurrentPopup();
 				}
@@ -1290,6 +2689,9 @@ namespace ifd {
 	}
 	void FileDialog::m_renderFileDialog()
 	{
+		m_pollDirectoryJob();
+		m_pollWatcher();
+
 		/***** TOP BAR *****/
 		bool noBackHistory = m_backHistory.empty(), noForwardHistory = m_forwardHistory.empty();
 
@@ -1335,8 +2737,15 @@ namespace ifd {
 		ImGui::SameLine();
 		ImGui::PopStyleColor();
 
-		if (ImGui::InputTextEx("##searchTB", "Search", m_searchBuffer, 128, ImVec2(-FLT_MIN, GUI_ELEMENT_SIZE), 0)) // TODO: no hardcoded literals
-			m_setDirectory(m_currentDirectory, false); // refresh
+		if (ImGui::Checkbox("Fuzzy##fuzzySearch", &m_fuzzySearch)) {
+			m_search(false);
+			m_selectedFileItem = -1;
+		}
+		ImGui::SameLine();
+		if (ImGui::InputTextEx("##searchTB", "Search", m_searchBuffer, 128, ImVec2(-FLT_MIN, GUI_ELEMENT_SIZE), 0)) { // TODO: no hardcoded literals
+			m_search(true);
+			m_selectedFileItem = -1;
+		}
 
 
 
@@ -1,12 +1,19 @@
 #pragma once
 #include <ctime>
+#include <deque>
+#include <mutex>
 #include <stack>
+#include <atomic>
 #include <string>
 #include <thread>
 #include <vector>
+#include <chrono>
+#include <memory>
 #include <functional>
 #include <filesystem>
 #include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
 #include <algorithm> // std::min, std::max
 
 #define IFD_DIALOG_FILE			0
@@ -14,6 +21,57 @@
 #define IFD_DIALOG_SAVE			2
 
 namespace ifd {
+	class PreviewCache;
+	class ProbeCache;
+
+	// Hands results from worker threads to the UI thread without a lock. Any
+	// thread may Push; one thread takes everything pushed so far with TakeAll,
+	// in the order it was pushed. Taking the whole list with one exchange
+	// means nodes are never popped one at a time, so there is no ABA problem.
+	template<typename T>
+	class HandoffStack {
+	public:
+		HandoffStack() = default;
+		HandoffStack(const HandoffStack&) = delete;
+		HandoffStack& operator=(const HandoffStack&) = delete;
+		~HandoffStack() { Clear(); }
+
+		void Push(T value) {
+			Node* node = new Node{ std::move(value), m_head.load(std::memory_order_relaxed) };
+			while (!m_head.compare_exchange_weak(node->Next, node, std::memory_order_release, std::memory_order_relaxed));
+		}
+		template<typename Container>
+		void TakeAll(Container& out) {
+			Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+			// the list is newest first
+			Node* oldest = nullptr;
+			while (node != nullptr) {
+				Node* next = node->Next;
+				node->Next = oldest;
+				oldest = node;
+				node = next;
+			}
+			while (oldest != nullptr) {
+				Node* next = oldest->Next;
+				out.push_back(std::move(oldest->Value));
+				delete oldest;
+				oldest = next;
+			}
+		}
+		void Clear() {
+			std::deque<T> dropped;
+			TakeAll(dropped);
+		}
+
+	private:
+		struct Node {
+			T Value;
+			Node* Next;
+		};
+		std::atomic<Node*> m_head{ nullptr };
+	};
+
 	class FileDialog {
 	public:
 		FileDialog();
@@ -24,6 +82,7 @@ namespace ifd {
 		bool Open(const std::string& key, const std::string& title, const std::string& filter, bool isMultiselect = false, const std::string& startingDir = "");
 
 		bool IsDone(const std::string& key);
+		inline bool IsOpen() const { return m_isOpen; }
 
 		inline bool HasResult() { return m_result.size(); }
 		inline const std::filesystem::path& GetResult() { return m_result[0]; }
@@ -45,6 +104,59 @@ namespace ifd {
 		virtual void* CreateTexture(uint8_t* data, int w, int h, char fmt) = 0;
 		std::function<void(void*)> DeleteTexture;
 
+		struct PreviewImage {
+			std::vector<uint8_t> Data; // RGBA
+			int Width = 0, Height = 0;
+		};
+		// Optional loader for previews of files stb_image can't read, e.g. video
+		// thumbnails; `size` is the largest side a preview is drawn at. Runs on
+		// the preview threads, several at a time.
+		std::function<bool(const std::filesystem::path& path, int size, PreviewImage& out)> LoadPreview;
+
+		struct PreviewStats {
+			size_t Loaded = 0;     // previews of the current directory
+			size_t Queued = 0;     // waiting for a preview thread
+			double PerSecond = 0;  // since the first one was requested
+			size_t Threads = 0;
+			size_t CacheHits = 0, CacheMisses = 0; // since the cache was set
+			size_t CacheBytes = 0;
+			size_t Uploading = 0;     // loaded, waiting for their turn to become textures
+			double WorstUploadMs = 0; // longest a frame spent creating textures, this directory
+		};
+		PreviewStats GetPreviewStats() const;
+		struct DirectoryStats {
+			size_t Entries = 0;
+			double FirstEntryMs = 0; // from entering the directory to the first entry shown
+			double TotalMs = 0;      // to the last one, so far while still Loading
+			bool Loading = false;
+			size_t Matches = 0;      // entries shown for the search box
+			double SearchMs = 0;     // the last filtering
+		};
+		DirectoryStats GetDirectoryStats() const;
+
+		// Keeps previews in `directory` between runs, the least recently used
+		// dropped beyond maxBytes; an empty path turns the cache off.
+		void SetPreviewCache(const std::filesystem::path& directory, size_t maxBytes);
+		// preview threads started from now on, 0 = one per core (at most 4)
+		inline void SetPreviewThreads(size_t count) { m_previewThreadCount = count; }
+		// Preview textures created per frame stop after `bytes` of pixels or
+		// `ms` milliseconds, whichever comes first; at least one always goes.
+		inline void SetPreviewUploadBudget(size_t bytes, double ms) { m_uploadBytesPerFrame = bytes; m_uploadMsPerFrame = ms; }
+
+		struct MediaInfo {
+			double Duration = 0; // seconds
+			int Width = 0, Height = 0;
+			double FrameRate = 0;
+			std::string Codec;
+		};
+		// Optional prober for media files. When set, the table view gets
+		// Duration, Resolution, Codec and FPS columns, filled in as the rows on
+		// screen are probed on threads of their own.
+		std::function<bool(const std::filesystem::path& path, MediaInfo& out)> ProbeMedia;
+		// Keeps probe results in `directory` between runs, keyed by path, size
+		// and date; an empty path turns the cache off.
+		void SetProbeCache(const std::filesystem::path& directory);
+
 		class FileTreeNode {
 		public:
 #ifdef _WIN32
@@ -72,10 +184,14 @@ namespace ifd {
 			size_t Size;
 			time_t DateModified;
 
-			bool HasIconPreview;
-			void* IconPreview;
-			uint8_t* IconPreviewData;
-			int IconPreviewWidth, IconPreviewHeight;
+			size_t Id; // slot in the preview and probe state, see m_allocateSlot
+			std::string SearchName; // file name folded to lower case
+
+			// formatted once so that drawing a row doesn't allocate
+			std::string DisplayName;
+			std::string DateString;
+			std::string SizeString;
+			std::string IconKey; // entries with the same key look the same
 		};
 
 	private:
@@ -95,7 +211,13 @@ namespace ifd {
 		float m_zoom;
 
 		std::vector<std::filesystem::path> m_selections;
-		int m_selectedFileItem;
+		struct PathHash {
+			size_t operator()(const std::filesystem::path& path) const { return std::filesystem::hash_value(path); }
+		};
+		std::unordered_set<std::filesystem::path, PathHash> m_selectionSet; // same paths as m_selections
+		void m_clearSelections();
+		int m_selectedFileItem;                  // position in m_filtered, only valid until the next sort
+		std::filesystem::path m_selectedFilePath; // what was right-clicked, for Delete
 		void m_select(const std::filesystem::path& path, bool isCtrlDown = false);
 
 		std::vector<std::filesystem::path> m_result;
@@ -110,24 +232,160 @@ namespace ifd {
 		std::vector<std::string> m_iconFilepaths; // m_iconIndices[x] <-> m_iconFilepaths[x]
 		std::unordered_map<std::string, void*> m_icons;
 		void* m_getIcon(const std::filesystem::path& path);
+		void* m_getIcon(const FileData& entry); // shared by every entry with the same IconKey
 		void m_clearIcons();
 		void m_refreshIconPreview();
 		void m_clearIconPreview();
 
-		std::thread* m_previewLoader;
-		bool m_previewLoaderRunning;
+		// Previews load on a few threads. The icon view asks for the entries it
+		// drew on screen first and tops the queue up with the rest; results are
+		// handed back to the UI thread, which owns all preview state.
+		struct Preview {
+			void* Texture = nullptr;
+			int Width = 0, Height = 0;
+			bool Requested = false;
+			unsigned int Serial = 0; // bumped when the slot is reset, older results are dropped
+		};
+		struct PreviewJob {
+			size_t Id;
+			unsigned int Serial; // of the slot when it was asked for
+			std::filesystem::path Path;
+			size_t Size;
+			time_t DateModified;
+		};
+		struct PreviewResult {
+			size_t Id;
+			unsigned int Serial;
+			unsigned int Generation;
+			PreviewImage Image;
+		};
+		std::vector<Preview> m_previews; // by FileData::Id
+		size_t m_previewCursor;          // next entry to prefetch
+		size_t m_previewsLoaded;
+		std::chrono::steady_clock::time_point m_previewStart, m_previewLast;
+		size_t m_previewThreadCount;
+		std::vector<std::thread> m_previewThreads;
+		mutable std::mutex m_previewMutex;
+		std::condition_variable m_previewWake;
+		std::deque<PreviewJob> m_previewQueue;      // guarded by m_previewMutex
+		HandoffStack<PreviewResult> m_previewResults;
+		std::atomic<unsigned int> m_previewGeneration; // bumped when previews are thrown away
+		bool m_previewStop;
+		std::unique_ptr<PreviewCache> m_previewCache;
+		std::deque<PreviewResult> m_previewUploads; // loaded previews, uploaded a few per frame
+		size_t m_uploadBytesPerFrame;
+		double m_uploadMsPerFrame;
+		double m_uploadWorstMs;
 		void m_stopPreviewLoader();
-		void m_loadPreview();
+		void m_previewWorker();
+		bool m_loadPreview(const std::filesystem::path& path, PreviewImage& out);
+		void m_requestPreviews(const std::vector<size_t>& visible);
+		void m_applyPreviews();
 
 		std::vector<FileTreeNode*> m_treeCache;
 		void m_clearTree(FileTreeNode* node);
 		void m_renderTree(FileTreeNode* node);
 
+		// Directories are read on a thread of their own that hands entries over
+		// in batches, so the list fills in while it stays usable. Entries are
+		// listed in the order read until the directory is complete, then sorted
+		// once. Leaving the directory just marks the job cancelled; the thread
+		// owns its share of the job and never touches the dialog.
+		struct DirectoryJob {
+			std::atomic<bool> Cancelled{ false };
+			std::mutex Mutex;
+			std::vector<FileData> Ready; // guarded by Mutex
+			bool Done = false;           // guarded by Mutex
+		};
+		std::shared_ptr<DirectoryJob> m_directoryJob;
+		std::chrono::steady_clock::time_point m_directoryStart;
+		double m_directoryFirstMs, m_directoryTotalMs;
+		void m_cancelDirectoryJob();
+		void m_pollDirectoryJob();
+		static void m_readDirectory(std::shared_ptr<DirectoryJob> job, std::filesystem::path directory, uint8_t type,
+			std::vector<std::string> extensions);
+		// Probes are asked for by the table rows on screen only and run on
+		// PROBE_THREADS threads; results come back to the UI thread like previews.
+		// Queued rows that scroll off screen are dropped from the queue.
+		struct Probe {
+			bool Requested = false;
+			bool Done = false;
+			unsigned int Serial = 0; // like Preview::Serial
+			MediaInfo Info;
+			std::string DurationString, ResolutionString, FrameRateString;
+		};
+		struct ProbeResult {
+			size_t Id;
+			unsigned int Serial;
+			unsigned int Generation;
+			bool Probed;
+			MediaInfo Info;
+		};
+		std::vector<Probe> m_probes; // by FileData::Id
+		std::vector<std::thread> m_probeThreads;
+		std::mutex m_probeMutex;
+		std::condition_variable m_probeWake;
+		std::deque<PreviewJob> m_probeQueue;       // guarded by m_probeMutex
+		HandoffStack<ProbeResult> m_probeResults;
+		std::atomic<unsigned int> m_probeGeneration; // bumped when the directory changes
+		bool m_probeStop;
+		std::unordered_set<size_t> m_probesMoved; // Ids whose sort key arrived since the last sort
+		std::chrono::steady_clock::time_point m_probesSorted;
+		std::unique_ptr<ProbeCache> m_probeCache;
+		void m_clearProbes();
+		void m_stopProbes();
+		void m_probeWorker();
+		void m_requestProbes(const std::vector<size_t>& visible); // every probed row on screen
+		void m_applyProbes();
+
+		static bool m_acceptEntry(const FileData& info, uint8_t type, const std::vector<std::string>& extensions);
+		std::vector<std::string> m_currentExtensions() const;
+
+		// On Linux the current directory is watched with inotify. Changed names
+		// are collected and applied together once events stop for a moment (or
+		// have kept coming for a second), so a burst of writes is one update
+		// and the directory is never read again in full.
+		int m_watchFd;
+		std::unordered_set<std::string> m_watchChanged;
+		bool m_watchOverflow;
+		std::chrono::steady_clock::time_point m_watchFirst, m_watchLast;
+		void m_watchDirectory(const std::filesystem::path& directory);
+		void m_stopWatching();
+		void m_pollWatcher();
+		void m_applyWatchedChanges();
+
+		// Previews and probes are kept by FileData::Id. A file that changes keeps
+		// its slot (reset), a file that goes away frees its slot for the next new
+		// one, so a folder that is written over and over doesn't grow them.
+		std::vector<size_t> m_freeSlots;
+		size_t m_allocateSlot();
+		void m_resetSlot(size_t id);
+
+		// m_content holds the whole directory; m_filtered the positions in it of
+		// the entries matching the search box, in display order. While the query
+		// only grows the last result is narrowed instead of scanning everything.
+		std::vector<size_t> m_filtered;
+		std::string m_filteredQuery;
+		bool m_filteredFuzzy;
+		bool m_fuzzySearch;
+		double m_searchMs;
+		void m_search(bool narrow);
+		bool m_matches(const FileData& entry) const;
+
 		unsigned int m_sortColumn;
 		unsigned int m_sortDirection;
 		std::vector<FileData> m_content;
 		void m_setDirectory(const std::filesystem::path& p, bool addHistory = true);
-		void m_sortContent(unsigned int column, unsigned int sortDirection);
+		// Only sorts the user asks for (a column click, a directory finished
+		// reading) use threads. Background updates move just the entries that
+		// changed: m_takeEntries removes them and m_insertSorted puts them back
+		// by binary search, both keeping m_filtered in step without a rescan.
+		void m_sortContent(unsigned int column, unsigned int sortDirection, bool parallel = false);
+		const MediaInfo* m_sortInfo(const FileData& entry) const;
+		bool m_sortLess(const FileData& left, const FileData& right) const;
+		std::vector<FileData> m_takeEntries(const std::vector<size_t>& positions); // ascending
+		void m_insertSorted(std::vector<FileData> entries);
+		void m_resortEntries(const std::unordered_set<size_t>& ids);
 		void m_renderContent();
 
 		void m_renderPopups();
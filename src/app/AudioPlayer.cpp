@@ -0,0 +1,312 @@
+#include "AudioPlayer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+AudioPlayer::~AudioPlayer()
+{
+    close();
+}
+
+bool AudioPlayer::open(int freq, SDL_AudioFormat format, int channels, int bufferFrames)
+{
+    close();
+
+    SDL_AudioSpec desired;
+    SDL_zero(desired);
+    desired.freq = freq;
+    desired.format = format;
+    desired.channels = channels;
+    desired.samples = bufferFrames;
+    desired.callback = &AudioPlayer::callback;
+    desired.userdata = this;
+
+    // no allowed changes: SDL converts for us if the device disagrees, and the
+    // buffer size we asked for is the one the callback sees
+    m_device = SDL_OpenAudioDevice(nullptr, 0, &desired, &m_spec, 0);
+    if (m_device == 0)
+    {
+        std::cerr << "sound device error: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    m_frameSize = SDL_AUDIO_BITSIZE(m_spec.format) / 8 * m_spec.channels;
+    m_stats = Stats{};
+    m_starved = false;
+    m_playing = false;
+    m_stats.deviceBufferMs = 1000.0 * m_spec.samples / m_spec.freq;
+    return true;
+}
+
+void AudioPlayer::close()
+{
+    if (m_device == 0)
+        return;
+    stopProducer();
+    SDL_CloseAudioDevice(m_device);
+    m_device = 0;
+    m_chunks.clear();
+    m_queuedBytes = 0;
+    m_playing = false;
+    m_source.clear();
+    m_sourceOffset = 0;
+    m_sourceFrameSize = 0;
+    m_resampler.reset();
+}
+
+bool AudioPlayer::load(std::string pcm, SDL_AudioFormat format, int freq, int channels, int bufferFrames,
+                       double leadMs, Resampler::Quality quality)
+{
+    int deviceFreq = freq;
+    SDL_AudioSpec native;
+    if (SDL_GetDefaultAudioInfo(nullptr, &native, 0) == 0 && native.freq > 0)
+        deviceFreq = native.freq;
+
+    if (!open(deviceFreq, AUDIO_F32SYS, channels, bufferFrames))
+        return false;
+
+    m_resampler.reset();
+    if (deviceFreq != freq)
+    {
+        m_resampler = std::make_unique<Resampler>(freq, deviceFreq, channels, quality);
+        std::cout << "resampling " << freq << " -> " << deviceFreq << " Hz ("
+                  << Resampler::qualityName(quality) << ", " << m_resampler->kernelName() << ")" << std::endl;
+    }
+    m_stretch = std::make_unique<TimeStretch>(deviceFreq, channels);
+    m_stretch->setSpeed(m_speed);
+    m_stretching = false;
+
+    m_source = std::move(pcm);
+    m_sourceOffset = 0;
+    m_sourceFormat = format;
+    m_sourceFrameSize = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+
+    m_stopProducer = false;
+    m_producer = std::thread(&AudioPlayer::produce, this, leadMs);
+    return true;
+}
+
+void AudioPlayer::setSpeed(double speed)
+{
+    // picked up by the producer thread with its next chunk
+    m_speed = speed;
+}
+
+void AudioPlayer::stopProducer()
+{
+    if (!m_producer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_producerMutex);
+        m_stopProducer = true;
+    }
+    m_producerWake.notify_one();
+    m_producer.join();
+}
+
+// Producer thread: keeps `leadMs` of the loaded file queued in front of the
+// device. It sleeps until the callback took audio, or a device buffer's time
+// at most, so a slow render frame can't starve the device.
+void AudioPlayer::produce(double leadMs)
+{
+    const auto backstop = std::chrono::duration<double, std::milli>(std::max(m_stats.deviceBufferMs, 1.0));
+    while (true)
+    {
+        while (queuedMs() < leadMs)
+            if (!produceChunk())
+                return;
+
+        std::unique_lock<std::mutex> lock(m_producerMutex);
+        if (m_stopProducer)
+            return;
+        m_producerWake.wait_for(lock, backstop);
+        if (m_stopProducer)
+            return;
+    }
+}
+
+// converts, resamples and stretches the next chunk of the loaded file and
+// queues it, false once the whole file is queued
+bool AudioPlayer::produceChunk()
+{
+    const size_t chunk = (size_t)m_spec.samples * m_sourceFrameSize;
+    size_t n = std::min(chunk, m_source.size() - m_sourceOffset);
+    n -= n % m_sourceFrameSize;
+    if (n == 0)
+        return false;
+    const uint64_t decodeTicks = SDL_GetPerformanceCounter();
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(m_source.data()) + m_sourceOffset;
+    m_sourceOffset += n;
+    const bool last = m_sourceOffset + m_sourceFrameSize > m_source.size();
+
+    toFloat(src, n / (SDL_AUDIO_BITSIZE(m_sourceFormat) / 8));
+    const float* samples = m_floatBuffer.data();
+    size_t frames = n / m_sourceFrameSize;
+    if (m_resampler)
+    {
+        m_resampled.clear();
+        frames = m_resampler->process(samples, frames, m_resampled);
+        if (last)
+            frames += m_resampler->flush(m_resampled);
+        samples = m_resampled.data();
+    }
+
+    m_stretched.clear();
+    const double speed = m_speed;
+    m_stretch->setSpeed(speed);
+    if (speed == 1.0)
+    {
+        // 1.0 skips the stretcher and its search, after handing out
+        // whatever it still holds from a different speed
+        if (m_stretching)
+            m_stretch->drain(m_stretched);
+        m_stretching = false;
+        push(reinterpret_cast<const uint8_t*>(m_stretched.data()), m_stretched.size() * sizeof(float), decodeTicks);
+        push(reinterpret_cast<const uint8_t*>(samples), frames * m_spec.channels * sizeof(float), decodeTicks);
+    }
+    else
+    {
+        m_stretching = true;
+        m_stretch->process(samples, frames, m_stretched);
+        if (last)
+            m_stretch->flush(m_stretched);
+        push(reinterpret_cast<const uint8_t*>(m_stretched.data()), m_stretched.size() * sizeof(float), decodeTicks);
+    }
+
+    if (last)
+    {
+        // the queue running dry after the last sample is the end, not an underrun
+        SDL_LockAudioDevice(m_device);
+        m_playing = false;
+        SDL_UnlockAudioDevice(m_device);
+    }
+    return !last;
+}
+
+// converts interleaved samples of the loaded file to native endian float
+void AudioPlayer::toFloat(const uint8_t* src, size_t samples)
+{
+    const int bytes = SDL_AUDIO_BITSIZE(m_sourceFormat) / 8;
+    const bool bigEndian = SDL_AUDIO_ISBIGENDIAN(m_sourceFormat) != 0;
+    m_floatBuffer.resize(samples);
+    for (size_t i = 0; i < samples; i++, src += bytes)
+    {
+        uint32_t v = 0;
+        for (int b = 0; b < bytes; b++)
+            v |= (uint32_t)src[bigEndian ? b : bytes - 1 - b] << (8 * (bytes - 1 - b));
+
+        if (SDL_AUDIO_ISFLOAT(m_sourceFormat))
+            memcpy(&m_floatBuffer[i], &v, sizeof(float));
+        else if (bytes == 2)
+            m_floatBuffer[i] = (int16_t)v / 32768.0f;
+        else
+            m_floatBuffer[i] = (float)((int32_t)v / 2147483648.0);
+    }
+}
+
+void AudioPlayer::push(const uint8_t* data, size_t bytes, uint64_t decodeTicks)
+{
+    if (m_device == 0 || bytes == 0)
+        return;
+    Chunk chunk{std::vector<uint8_t>(data, data + bytes), 0, decodeTicks ? decodeTicks : SDL_GetPerformanceCounter()};
+
+    SDL_LockAudioDevice(m_device);
+    m_queuedBytes += bytes;
+    m_playing = true;
+    m_chunks.push_back(std::move(chunk));
+    SDL_UnlockAudioDevice(m_device);
+}
+
+void AudioPlayer::clear()
+{
+    if (m_device == 0)
+        return;
+    SDL_LockAudioDevice(m_device);
+    m_chunks.clear();
+    m_queuedBytes = 0;
+    m_playing = false;
+    SDL_UnlockAudioDevice(m_device);
+}
+
+void AudioPlayer::setPaused(bool paused)
+{
+    if (m_device != 0)
+        SDL_PauseAudioDevice(m_device, paused ? 1 : 0);
+}
+
+size_t AudioPlayer::queuedBytes() const
+{
+    if (m_device == 0)
+        return 0;
+    SDL_LockAudioDevice(m_device);
+    size_t bytes = m_queuedBytes;
+    SDL_UnlockAudioDevice(m_device);
+    return bytes;
+}
+
+double AudioPlayer::queuedMs() const
+{
+    if (m_frameSize == 0)
+        return 0.0;
+    return 1000.0 * (queuedBytes() / m_frameSize) / m_spec.freq;
+}
+
+AudioPlayer::Stats AudioPlayer::stats() const
+{
+    if (m_device == 0)
+        return m_stats;
+    SDL_LockAudioDevice(m_device);
+    Stats stats = m_stats;
+    SDL_UnlockAudioDevice(m_device);
+    stats.queuedMs = queuedMs();
+    return stats;
+}
+
+double AudioPlayer::ticksToMs(uint64_t ticks) const
+{
+    return 1000.0 * (double)ticks / (double)SDL_GetPerformanceFrequency();
+}
+
+void AudioPlayer::callback(void* userdata, Uint8* stream, int len)
+{
+    static_cast<AudioPlayer*>(userdata)->fill(stream, len);
+}
+
+// runs on the SDL audio thread with the device lock held
+void AudioPlayer::fill(Uint8* stream, int len)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    while (len > 0 && !m_chunks.empty())
+    {
+        Chunk& chunk = m_chunks.front();
+        if (chunk.offset == 0)
+        {
+            // the chunk is written now and heard once the device buffer drained
+            double latency = ticksToMs(now - chunk.decodeTicks) + m_stats.deviceBufferMs;
+            m_stats.latencyMs = latency;
+            m_stats.latencyAvgMs = m_stats.latencyAvgMs == 0.0 ? latency : m_stats.latencyAvgMs * 0.95 + latency * 0.05;
+            m_stats.latencyMaxMs = std::max(m_stats.latencyMaxMs, latency);
+        }
+
+        size_t n = std::min<size_t>(len, chunk.data.size() - chunk.offset);
+        memcpy(stream, chunk.data.data() + chunk.offset, n);
+        chunk.offset += n;
+        stream += n;
+        len -= (int)n;
+        m_queuedBytes -= n;
+        if (chunk.offset == chunk.data.size())
+            m_chunks.pop_front();
+    }
+    if (len > 0)
+    {
+        // before the first chunk and after the last one silence is expected
+        memset(stream, m_spec.silence, len);
+        if (!m_starved && m_playing)
+            m_stats.underruns++;
+        m_starved = true;
+    }
+    else
+        m_starved = false;
+    m_producerWake.notify_one();
+}
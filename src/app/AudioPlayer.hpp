@@ -0,0 +1,111 @@
+#pragma once
+
+#include "SDL2/SDL.h"
+#include "src/decoder/resampler.hpp"
+#include "src/decoder/time_stretch.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Callback driven audio output with a small, explicit device buffer.
+//
+// Samples are pushed in chunks by the producer and pulled by the SDL audio
+// callback. Every chunk remembers when it was decoded, which lets the player
+// measure how long it takes for decoded audio to reach the device.
+//
+// A whole decoded file can be handed over with load(); a producer thread then
+// feeds it to the device a chunk at a time as float samples, independent of
+// how long the render loop takes for a frame. If the file's rate differs
+// from the device's native rate the samples are resampled by us instead of
+// SDL, and setSpeed() time-stretches them without changing the pitch. At 1.0
+// the stretcher is bypassed.
+class AudioPlayer {
+public:
+    struct Stats {
+        double deviceBufferMs = 0.0; // latency added by the device buffer alone
+        double latencyMs = 0.0;      // decode -> device, last chunk
+        double latencyAvgMs = 0.0;   // decode -> device, moving average
+        double latencyMaxMs = 0.0;
+        double queuedMs = 0.0;       // audio waiting in front of the device
+        uint32_t underruns = 0;      // times the queue ran dry while playing
+    };
+
+    AudioPlayer() = default;
+    ~AudioPlayer();
+    AudioPlayer(const AudioPlayer&) = delete;
+    AudioPlayer& operator=(const AudioPlayer&) = delete;
+
+    // bufferFrames is the device buffer size in sample frames (per channel)
+    bool open(int freq, SDL_AudioFormat format, int channels, int bufferFrames);
+    void close();
+    bool isOpen() const { return m_device != 0; }
+
+    // Opens the default device at its native rate and plays `pcm` from there,
+    // keeping `leadMs` of audio queued in front of the device.
+    bool load(std::string pcm, SDL_AudioFormat format, int freq, int channels, int bufferFrames, double leadMs,
+              Resampler::Quality quality = Resampler::Quality::Medium);
+    // playback speed of the loaded file, 0.5 .. 3.0
+    void setSpeed(double speed);
+    bool isResampling() const { return m_resampler != nullptr; }
+    const Resampler* resampler() const { return m_resampler.get(); }
+
+    // decodeTicks: performance counter when the samples were decoded, 0 = now
+    void push(const uint8_t* data, size_t bytes, uint64_t decodeTicks = 0);
+    void clear();
+    void setPaused(bool paused);
+
+    size_t queuedBytes() const;
+    double queuedMs() const;
+    int frameSize() const { return m_frameSize; }
+    const SDL_AudioSpec& spec() const { return m_spec; }
+    Stats stats() const;
+
+private:
+    struct Chunk {
+        std::vector<uint8_t> data;
+        size_t offset;
+        uint64_t decodeTicks;
+    };
+
+    static void callback(void* userdata, Uint8* stream, int len);
+    void fill(Uint8* stream, int len);
+    void produce(double leadMs);
+    bool produceChunk();
+    void stopProducer();
+    double ticksToMs(uint64_t ticks) const;
+    void toFloat(const uint8_t* src, size_t samples);
+
+    // file handed over with load(), only touched by the producer thread
+    // while it runs
+    std::string m_source;
+    size_t m_sourceOffset = 0;
+    SDL_AudioFormat m_sourceFormat = 0;
+    int m_sourceFrameSize = 0;
+    std::unique_ptr<Resampler> m_resampler;
+    std::unique_ptr<TimeStretch> m_stretch;
+    bool m_stretching = false; // the stretcher holds input, speed was != 1.0
+    std::vector<float> m_floatBuffer, m_resampled, m_stretched;
+    std::atomic<double> m_speed{1.0};
+
+    std::thread m_producer;
+    std::mutex m_producerMutex;
+    std::condition_variable m_producerWake; // stop, or the callback took audio
+    bool m_stopProducer = false;
+
+    SDL_AudioDeviceID m_device = 0;
+    SDL_AudioSpec m_spec{};
+    int m_frameSize = 0;
+
+    // guarded by SDL_LockAudioDevice
+    std::deque<Chunk> m_chunks;
+    size_t m_queuedBytes = 0;
+    bool m_starved = false;
+    bool m_playing = false;  // audio was queued and the source isn't finished
+    Stats m_stats;
+};
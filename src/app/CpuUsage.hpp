@@ -0,0 +1,56 @@
+#pragma once
+
+#include "SDL2/SDL.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+// CPU time used by the whole process, as a percentage of one core, averaged
+// over windows of at least half a second.
+class CpuUsage {
+public:
+    // call regularly; the value changes once per window
+    void update() {
+        Uint64 now = SDL_GetPerformanceCounter();
+        double cpu = processSeconds();
+        if (m_wallStart == 0) {
+            m_wallStart = now;
+            m_cpuStart = cpu;
+            return;
+        }
+        double wall = (double)(now - m_wallStart) / (double)SDL_GetPerformanceFrequency();
+        if (wall < 0.5)
+            return;
+        m_percent = 100.0 * (cpu - m_cpuStart) / wall;
+        m_wallStart = now;
+        m_cpuStart = cpu;
+    }
+
+    double percent() const { return m_percent; }
+
+private:
+    static double processSeconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+            return 0.0;
+        auto seconds = [](const FILETIME& t) {
+            return (double)(((Uint64)t.dwHighDateTime << 32) | t.dwLowDateTime) * 1e-7;
+        };
+        return seconds(kernel) + seconds(user);
+#else
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    Uint64 m_wallStart = 0;
+    double m_cpuStart = 0.0;
+    double m_percent = 0.0;
+};
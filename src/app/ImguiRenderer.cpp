@@ -1,6 +1,6 @@
 #include "ImguiRenderer.hpp"
 
-ImguiRenderer::ImguiRenderer(SDL_Window *window, const char *glsl_version)
+ImguiRenderer::ImguiRenderer(SDL_Window *window, const char *glsl_version, bool viewports)
 {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -8,7 +8,8 @@ ImguiRenderer::ImguiRenderer(SDL_Window *window, const char *glsl_version)
     (void)io;
 
     io->ConfigFlags |= ImGuiConfigFlags_DockingEnable;   // Enable Docking
-    io->ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Enable Multi-Viewport / Platform Windows
+    if (viewports)
+        io->ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Enable Multi-Viewport / Platform Windows
     // Setup Platform/Renderer bindings
     ImGui::StyleColorsDark();
     ImGuiStyle &style = ImGui::GetStyle();
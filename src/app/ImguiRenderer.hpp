@@ -8,7 +8,9 @@
 
 class ImguiRenderer {
 public:
-    ImguiRenderer(SDL_Window *window, const char *glsl_version);
+    // viewports = false keeps every ImGui window inside the main one, e.g.
+    // when rendering offscreen
+    ImguiRenderer(SDL_Window *window, const char *glsl_version, bool viewports = true);
 
     void NewFrame();
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "SDL2/SDL.h"
+
+// Media time that advances with the wall clock scaled by the playback speed.
+// Changing the speed or pausing rebases the clock, so time never jumps.
+class PlaybackClock {
+public:
+    double time() const {
+        if (m_paused)
+            return m_base;
+        return m_base + secondsSince(m_start) * m_speed;
+    }
+
+    void play() {
+        if (!m_paused)
+            return;
+        m_start = SDL_GetPerformanceCounter();
+        m_paused = false;
+    }
+
+    void pause() {
+        m_base = time();
+        m_paused = true;
+    }
+
+    void setSpeed(double speed) {
+        m_base = time();
+        m_start = SDL_GetPerformanceCounter();
+        m_speed = speed;
+    }
+
+    void reset(double time = 0.0) {
+        m_base = time;
+        m_start = SDL_GetPerformanceCounter();
+    }
+
+    double speed() const { return m_speed; }
+    bool paused() const { return m_paused; }
+
+private:
+    static double secondsSince(Uint64 ticks) {
+        return (double)(SDL_GetPerformanceCounter() - ticks) / (double)SDL_GetPerformanceFrequency();
+    }
+
+    double m_base = 0.0;
+    Uint64 m_start = 0;
+    double m_speed = 1.0;
+    bool m_paused = true;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SDL2/SDL.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Wall time of every stage of the render loop, frame by frame, for the
+// headless benchmark. mark(stage) charges the time since the previous mark
+// (or beginFrame) to `stage`; report() prints average, median, 95th
+// percentile and maximum per stage.
+class StageTimer {
+public:
+    explicit StageTimer(std::vector<std::string> names) : m_names(std::move(names)), m_samples(m_names.size()) {}
+
+    void beginFrame() {
+        m_last = SDL_GetPerformanceCounter();
+        for (auto& samples : m_samples)
+            samples.push_back(0.0);
+    }
+
+    void mark(size_t stage) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        m_samples[stage].back() += 1000.0 * (double)(now - m_last) / (double)SDL_GetPerformanceFrequency();
+        m_last = now;
+    }
+
+    size_t frames() const { return m_samples.empty() ? 0 : m_samples[0].size(); }
+
+    void report(FILE* out) const {
+        fprintf(out, "%-16s %9s %9s %9s %9s\n", "stage (ms)", "avg", "median", "p95", "max");
+        std::vector<double> total(frames(), 0.0);
+        for (size_t i = 0; i < m_names.size(); i++) {
+            for (size_t f = 0; f < total.size(); f++)
+                total[f] += m_samples[i][f];
+            print(out, m_names[i].c_str(), m_samples[i]);
+        }
+        print(out, "frame", total);
+    }
+
+private:
+    static void print(FILE* out, const char* name, std::vector<double> samples) {
+        if (samples.empty())
+            return;
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        std::sort(samples.begin(), samples.end());
+        fprintf(out, "%-16s %9.3f %9.3f %9.3f %9.3f\n", name, sum / samples.size(), samples[samples.size() / 2],
+                samples[std::min(samples.size() - 1, samples.size() * 95 / 100)], samples.back());
+    }
+
+    std::vector<std::string> m_names;
+    std::vector<std::vector<double>> m_samples;
+    Uint64 m_last = 0;
+};
@@ -0,0 +1,267 @@
+#include "StreamGrid.hpp"
+#include "imgui.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+// converted frames a stream may hold ahead of presentation
+static constexpr size_t READY_FRAMES = 2;
+
+StreamGrid::StreamGrid(WorkerPool& pool)
+    : m_pool(pool)
+{
+    wakeEvent();
+}
+
+StreamGrid::~StreamGrid()
+{
+    std::unique_lock<std::mutex> lock(m_inFlightMutex);
+    m_inFlightDone.wait(lock, [this] { return m_inFlight == 0; });
+}
+
+Uint32 StreamGrid::wakeEvent()
+{
+    static const Uint32 event = SDL_RegisterEvents(1);
+    return event;
+}
+
+bool StreamGrid::add(const std::string& filename)
+{
+    auto stream = std::make_unique<Stream>();
+    try
+    {
+        stream->reader = std::make_unique<VideoReader>(filename.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << filename << ": " << e.what() << std::endl;
+        return false;
+    }
+    stream->name = std::filesystem::path(filename).filename().string();
+    stream->streamer = std::make_unique<TextureStreamer>();
+    m_streams.push_back(std::move(stream));
+    return true;
+}
+
+void StreamGrid::schedule(Stream& stream, double time)
+{
+    if (stream.busy)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        if (stream.eof || stream.ready.size() >= READY_FRAMES)
+            return;
+    }
+    stream.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(m_inFlightMutex);
+        m_inFlight++;
+    }
+    m_pool.submit([this, &stream, time]() {
+        decode(stream, time);
+        stream.busy = false;
+        std::lock_guard<std::mutex> lock(m_inFlightMutex);
+        if (--m_inFlight == 0)
+            m_inFlightDone.notify_all();
+    });
+}
+
+// runs on the pool: decodes until a frame that isn't overdue yet, converts it
+// at the tile size and queues it
+void StreamGrid::decode(Stream& stream, double time)
+{
+    Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        if (!stream.spare.empty())
+        {
+            frame = std::move(stream.spare.back());
+            stream.spare.pop_back();
+        }
+    }
+
+    VideoReader& reader = *stream.reader;
+    const VideoReaderState& state = reader.videoReaderState;
+    while (true)
+    {
+        if (!reader.video_reader_decode_frame())
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            stream.eof = true;
+            return;
+        }
+        double t = *reader.pts * av_q2d(state.time_base);
+        if (!stream.started)
+        {
+            stream.origin = t;
+            stream.started = true;
+        }
+        t -= stream.origin;
+        if (t > stream.lastTime)
+            stream.frameInterval = t - stream.lastTime;
+        stream.lastTime = t;
+
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        stream.decoded++;
+        // its successor is due already, don't bother converting it
+        if (stream.frameInterval > 0.0 && t + stream.frameInterval <= time)
+        {
+            stream.droppedEarly++;
+            continue;
+        }
+        frame.time = t;
+        break;
+    }
+
+    // fit the tile, never larger than the source; the GPU scales up for free
+    int tileW = stream.tileWidth, tileH = stream.tileHeight;
+    double scale = 1.0;
+    if (tileW > 0 && tileH > 0)
+        scale = std::min({(double)tileW / state.width, (double)tileH / state.height, 1.0});
+    frame.width = std::max(2, (int)(state.width * scale) & ~1);
+    frame.height = std::max(2, (int)(state.height * scale) & ~1);
+    frame.pixels.resize((size_t)frame.width * frame.height * 4);
+
+    reader.video_reader_set_output_size(frame.width, frame.height);
+    uint8_t* dest[4] = { frame.pixels.data(), nullptr, nullptr, nullptr };
+    int dest_linesize[4] = { frame.width * 4, 0, 0, 0 };
+    reader.video_reader_convert_frame(dest, dest_linesize);
+
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+        stream.ready.push_back(std::move(frame));
+    }
+    SDL_Event event;
+    SDL_zero(event);
+    event.type = wakeEvent();
+    SDL_PushEvent(&event);
+}
+
+bool StreamGrid::update(double time)
+{
+    bool presented = false;
+    for (auto& ptr : m_streams)
+    {
+        Stream& stream = *ptr;
+
+        // newest frame that is due, the ones before it are dropped
+        Frame frame;
+        bool got = false;
+        {
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            while (!stream.ready.empty() && stream.ready.front().time <= time)
+            {
+                if (got)
+                {
+                    stream.spare.push_back(std::move(frame));
+                    stream.droppedLate++;
+                }
+                frame = std::move(stream.ready.front());
+                stream.ready.pop_front();
+                got = true;
+            }
+            stream.stats.framesDecoded = stream.decoded;
+            stream.stats.framesDropped = stream.droppedEarly + stream.droppedLate;
+        }
+
+        if (got)
+        {
+            stream.streamer->resize(frame.width, frame.height);
+            stream.streamer->upload(frame.pixels.data());
+            stream.hasFrame = true;
+            presented = true;
+
+            double lateness = (time - frame.time) * 1000.0;
+            StreamStats& stats = stream.stats;
+            stats.latenessMs = stats.latenessMs * 0.9 + lateness * 0.1;
+            stats.latenessMaxMs = std::max(stats.latenessMaxMs, lateness);
+
+            std::lock_guard<std::mutex> lock(stream.mutex);
+            stream.spare.push_back(std::move(frame));
+        }
+        schedule(stream, time);
+    }
+
+    // decoded frames per second, per stream and in total
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if (m_windowStart == 0)
+        m_windowStart = now;
+    const double window = (double)(now - m_windowStart) / (double)SDL_GetPerformanceFrequency();
+    if (window >= 1.0)
+    {
+        m_aggregateFps = 0.0;
+        for (auto& stream : m_streams)
+        {
+            stream->stats.decodedFps = (stream->stats.framesDecoded - stream->decodedAtWindow) / window;
+            stream->decodedAtWindow = stream->stats.framesDecoded;
+            m_aggregateFps += stream->stats.decodedFps;
+        }
+        m_windowStart = now;
+    }
+    return presented;
+}
+
+double StreamGrid::nextFrameTime() const
+{
+    // streams with nothing ready wake the loop with wakeEvent() instead
+    double next = INFINITY;
+    for (const auto& stream : m_streams)
+    {
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        if (!stream->ready.empty())
+            next = std::min(next, stream->ready.front().time);
+    }
+    return next;
+}
+
+void StreamGrid::draw()
+{
+    const int count = (int)m_streams.size();
+    if (count == 0)
+        return;
+
+    // initial layout: as square a grid as possible below the menu bar
+    const int cols = (int)std::ceil(std::sqrt((double)count));
+    const int rows = (count + cols - 1) / cols;
+    const ImVec2 display = ImGui::GetIO().DisplaySize;
+    const float top = ImGui::GetFrameHeight();
+    const ImVec2 cell{display.x / cols, (display.y - top) / rows};
+
+    for (int i = 0; i < count; i++)
+    {
+        Stream& stream = *m_streams[i];
+        ImGui::SetNextWindowPos(ImVec2{cell.x * (i % cols), top + cell.y * (i / cols)}, ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowSize(cell, ImGuiCond_FirstUseEver);
+        ImGui::Begin((stream.name + "##feed" + std::to_string(i)).c_str());
+        const ImVec2 avail = ImGui::GetContentRegionAvail();
+        stream.tileWidth = (int)avail.x;
+        stream.tileHeight = (int)avail.y;
+        if (stream.hasFrame && avail.x > 0.0f && avail.y > 0.0f)
+        {
+            const VideoReaderState& state = stream.reader->videoReaderState;
+            const float scale = std::min(avail.x / state.width, avail.y / state.height);
+            ImGui::Image(reinterpret_cast<ImTextureID>(stream.streamer->texture()),
+                         ImVec2{state.width * scale, state.height * scale});
+        }
+        ImGui::End();
+    }
+}
+
+void StreamGrid::drawStats()
+{
+    ImGui::Begin("Grid");
+    ImGui::Text("%zu streams, %zu decode threads, %zu tasks queued", m_streams.size(), m_pool.size(), m_pool.pending());
+    ImGui::Text("Decoded: %.1f fps in total", m_aggregateFps);
+    for (size_t i = 0; i < m_streams.size(); i++)
+    {
+        const Stream& stream = *m_streams[i];
+        const StreamStats& stats = stream.stats;
+        ImGui::Text("%2zu %-24s %5.1f fps  %dx%d  late %6.1f ms (max %6.1f)  dropped %llu", i, stream.name.c_str(),
+                    stats.decodedFps, stream.streamer->width(), stream.streamer->height(), stats.latenessMs,
+                    stats.latenessMaxMs, (unsigned long long)stats.framesDropped);
+    }
+    ImGui::End();
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "TextureStreamer.hpp"
+#include "SDL2/SDL.h"
+#include "src/decoder/video_reader.hpp"
+#include "src/decoder/worker_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Several video files played side by side, one ImGui window per file laid
+// out as a grid.
+//
+// Every stream has its own VideoReader, but decoding runs as tasks on a
+// shared WorkerPool: a stream gets a task whenever it has room for another
+// converted frame, so the number of threads is fixed by the pool, not by the
+// number of streams. Frames are scaled to the size of the stream's tile while
+// converting, and a frame that is already overdue once it is decoded is
+// dropped before conversion.
+class StreamGrid {
+public:
+    struct StreamStats {
+        double decodedFps = 0.0;
+        double latenessMs = 0.0;    // presentation time - due time, moving average
+        double latenessMaxMs = 0.0;
+        uint64_t framesDecoded = 0;
+        uint64_t framesDropped = 0; // decoded but never shown
+    };
+
+    explicit StreamGrid(WorkerPool& pool);
+    ~StreamGrid();
+    StreamGrid(const StreamGrid&) = delete;
+    StreamGrid& operator=(const StreamGrid&) = delete;
+
+    // returns false if the file can't be opened
+    bool add(const std::string& filename);
+    size_t size() const { return m_streams.size(); }
+
+    // Presents the frames due at `time` and schedules more decoding.
+    // Returns true if any tile got a new frame.
+    bool update(double time);
+    // One window per stream; tile sizes are picked up for the next frames.
+    void draw();
+    void drawStats();
+
+    // earliest media time at which update() has something new to show
+    double nextFrameTime() const;
+    // SDL event pushed when a frame finished decoding, to wake an idle main loop
+    static Uint32 wakeEvent();
+    double aggregateFps() const { return m_aggregateFps; }
+    const StreamStats& stats(size_t i) const { return m_streams[i]->stats; }
+
+private:
+    struct Frame {
+        std::vector<uint8_t> pixels; // RGB0
+        int width = 0, height = 0;
+        double time = 0.0;
+    };
+
+    struct Stream {
+        std::string name;
+        std::unique_ptr<VideoReader> reader;
+        std::unique_ptr<TextureStreamer> streamer;
+
+        // filled on the pool; guarded by mutex
+        mutable std::mutex mutex;
+        std::deque<Frame> ready;
+        std::vector<Frame> spare;
+        bool eof = false;
+        uint64_t decoded = 0;
+        uint64_t droppedEarly = 0;
+
+        // worker side only
+        bool started = false;
+        double origin = 0.0;
+        double lastTime = 0.0;
+        double frameInterval = 0.0;
+
+        // set by the main thread, read by the task
+        std::atomic<bool> busy{false};
+        std::atomic<int> tileWidth{0}, tileHeight{0};
+
+        // main thread only
+        bool hasFrame = false;
+        uint64_t droppedLate = 0;
+        uint64_t decodedAtWindow = 0;
+        StreamStats stats;
+    };
+
+    void schedule(Stream& stream, double time);
+    void decode(Stream& stream, double time);
+
+    WorkerPool& m_pool;
+    std::vector<std::unique_ptr<Stream>> m_streams;
+
+    // tasks in flight, the destructor waits for them
+    std::mutex m_inFlightMutex;
+    std::condition_variable m_inFlightDone;
+    int m_inFlight = 0;
+
+    uint64_t m_windowStart = 0;
+    double m_aggregateFps = 0.0;
+};
@@ -0,0 +1,194 @@
+#include "TextureStreamer.hpp"
+
+#include <cstring>
+
+static constexpr GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+TextureStreamer::TextureStreamer()
+    : m_persistent(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
+{
+    glGenTextures(1, &m_texture);
+    glGenBuffers(RING_SIZE, m_pbos);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    release();
+    glDeleteBuffers(RING_SIZE, m_pbos);
+    glDeleteTextures(1, &m_texture);
+}
+
+void TextureStreamer::release()
+{
+    for (GLsync& fence : m_fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void TextureStreamer::resize(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+
+    // immutable storage can't be resized, start over with a new texture
+    release();
+    glDeleteTextures(1, &m_texture);
+    glGenTextures(1, &m_texture);
+    m_width = width;
+    m_height = height;
+    m_size = m_blockBytes ? (size_t)((width + 3) / 4) * ((height + 3) / 4) * m_blockBytes : (size_t)width * height * 4;
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    if (GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_storage)
+        glTexStorage2D(GL_TEXTURE_2D, 1, m_internalFormat, width, height);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, m_internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // the padding byte of RGB0/BGR0 frames is undefined
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_ONE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_persistent)
+    {
+        // buffer storage is immutable as well, deleting the buffers unmaps them
+        glDeleteBuffers(RING_SIZE, m_pbos);
+        glGenBuffers(RING_SIZE, m_pbos);
+    }
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbos[i]);
+        if (m_persistent)
+        {
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_size, nullptr, PERSISTENT_FLAGS);
+            m_mapped[i] = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_size, PERSISTENT_FLAGS));
+        }
+        else
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    m_next = 0;
+}
+
+void TextureStreamer::setFormat(GLenum format, int bytesPerPixel)
+{
+    m_format = format;
+    m_bytesPerPixel = bytesPerPixel;
+}
+
+void TextureStreamer::setCompressed(GLenum internalFormat, int blockBytes)
+{
+    m_internalFormat = blockBytes ? internalFormat : GL_RGBA8;
+    m_blockBytes = blockBytes;
+    // storage is immutable, reallocate at the same size
+    const int width = m_width, height = m_height;
+    m_width = m_height = 0;
+    resize(width, height);
+}
+
+uint8_t* TextureStreamer::beginUpload(int* stride)
+{
+    return beginUpload(0, 0, m_width, m_height, stride);
+}
+
+uint8_t* TextureStreamer::beginUpload(int x, int y, int w, int h, int* stride)
+{
+    if (m_blockBytes)
+    {
+        x = y = 0;
+        w = m_width;
+        h = m_height;
+    }
+    m_regionX = x;
+    m_regionY = y;
+    m_regionW = w;
+    m_regionH = h;
+    *stride = m_blockBytes ? (w + 3) / 4 * m_blockBytes : w * m_bytesPerPixel;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbos[m_next]);
+    if (m_persistent)
+    {
+        GLsync& fence = m_fences[m_next];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                m_waits++;
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        if (!m_mapped[m_next])
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return m_mapped[m_next];
+    }
+
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    GLsync& fence = m_fences[m_next];
+    if (fence)
+    {
+        // a poll, never a wait
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+            m_orphaned++;
+        }
+        else
+        {
+            access |= GL_MAP_UNSYNCHRONIZED_BIT;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    else
+    {
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+    }
+
+    const size_t bytes = m_blockBytes ? m_size : (size_t)w * h * m_bytesPerPixel;
+    void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, access);
+    if (!ptr)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return static_cast<uint8_t*>(ptr);
+}
+
+void TextureStreamer::endUpload()
+{
+    // coherent mappings need neither an unmap nor a flush
+    if (!m_persistent)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, m_bytesPerPixel == 4 ? 4 : 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (m_blockBytes)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_width, m_height, m_internalFormat, (GLsizei)m_size, nullptr);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, m_regionX, m_regionY, m_regionW, m_regionH, m_format, GL_UNSIGNED_BYTE,
+                        nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // signalled once the driver is done reading this PBO
+    m_fences[m_next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_next = (m_next + 1) % RING_SIZE;
+}
+
+void TextureStreamer::upload(const uint8_t* pixels)
+{
+    int stride;
+    uint8_t* dst = beginUpload(&stride);
+    if (!dst)
+        return;
+    memcpy(dst, pixels, m_blockBytes ? m_size : (size_t)stride * m_height);
+    endUpload();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+
+// Streams RGBA frames into a texture without stalling the render thread.
+// Frames may also arrive as BGRA or 24-bit RGB/BGR, see setFormat(); the
+// texture is RGBA8 either way and always samples as opaque.
+//
+// The texture gets immutable storage once per resolution and is only ever
+// updated with glTexSubImage2D. Pixels go through a ring of pixel buffer
+// objects: a frame is written into the next PBO of the ring while the driver
+// may still be reading the previous ones. Every PBO carries a fence from its
+// last upload; if it hasn't signalled yet the buffer is orphaned instead of
+// waited on, otherwise it is mapped unsynchronized.
+//
+// With GL 4.4 / ARB_buffer_storage the PBOs are instead mapped once,
+// persistently and coherently, and beginUpload() hands out the mapping. Such
+// buffers can't be orphaned, so there an unsignalled fence is waited for,
+// which with three buffers in flight practically never happens.
+class TextureStreamer {
+public:
+    static constexpr int RING_SIZE = 3;
+
+    TextureStreamer();
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // (Re)allocates the texture and the PBOs if the size changed.
+    void resize(int width, int height);
+    // Pixel transfer format of the uploads: GL_RGBA, GL_BGRA, GL_RGB or
+    // GL_BGR with 4 or 3 bytes per pixel. GL_RGBA by default.
+    void setFormat(GLenum format, int bytesPerPixel);
+    // Switches the texture to a block compressed internal format (e.g.
+    // GL_COMPRESSED_RGB_S3TC_DXT1_EXT) whose 4x4 blocks take blockBytes;
+    // uploads are then the raw blocks of whole frames. 0 goes back to RGBA8.
+    void setCompressed(GLenum internalFormat, int blockBytes);
+    bool compressed() const { return m_blockBytes != 0; }
+
+    // Maps the next PBO for writing a width * height frame, `stride` is
+    // set to the bytes per row. Writers can fill it directly (e.g. sws_scale)
+    // instead of staging the frame elsewhere. Returns nullptr if the buffer
+    // can't be mapped.
+    uint8_t* beginUpload(int* stride);
+    // Same for a w x h rectangle of the texture at (x, y); only that many
+    // bytes are mapped and uploaded. Compressed textures take whole frames.
+    uint8_t* beginUpload(int x, int y, int w, int h, int* stride);
+    // Unmaps the PBO and updates the texture from it.
+    void endUpload();
+    // beginUpload, copy, endUpload
+    void upload(const uint8_t* pixels);
+
+    GLuint texture() const { return m_texture; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    bool persistent() const { return m_persistent; }
+    // PBOs that were still in use by the driver and had to be orphaned
+    uint64_t orphaned() const { return m_orphaned; }
+    // persistent PBOs that were still in use and had to be waited for
+    uint64_t waits() const { return m_waits; }
+
+private:
+    void release();
+
+    GLuint m_texture = 0;
+    GLuint m_pbos[RING_SIZE] = {};
+    GLsync m_fences[RING_SIZE] = {};
+    uint8_t* m_mapped[RING_SIZE] = {}; // persistent mappings
+    bool m_persistent = false;
+    int m_next = 0;
+    int m_width = 0, m_height = 0;
+    size_t m_size = 0;
+    GLenum m_format = GL_RGBA;
+    int m_bytesPerPixel = 4;
+    GLenum m_internalFormat = GL_RGBA8;
+    int m_blockBytes = 0; // compressed when not 0
+    int m_regionX = 0, m_regionY = 0, m_regionW = 0, m_regionH = 0; // of the upload in progress
+    uint64_t m_orphaned = 0;
+    uint64_t m_waits = 0;
+};
@@ -0,0 +1,333 @@
+#include "VideoStream.hpp"
+#include "SDL2/SDL.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// Packed formats glTexSubImage2D takes as they are. A decoder that outputs
+// one of them has its frames copied, anything else is converted to the first.
+static const struct
+{
+    AVPixelFormat pixFmt;
+    GLenum format;
+    int bytesPerPixel;
+} UPLOAD_FORMATS[] = {
+    { AV_PIX_FMT_RGB0, GL_RGBA, 4 },
+    { AV_PIX_FMT_RGBA, GL_RGBA, 4 },
+    { AV_PIX_FMT_BGR0, GL_BGRA, 4 },
+    { AV_PIX_FMT_BGRA, GL_BGRA, 4 },
+    { AV_PIX_FMT_RGB24, GL_RGB, 3 },
+    { AV_PIX_FMT_BGR24, GL_BGR, 3 },
+};
+
+VideoStream::VideoStream(const char* filename, UploadMode mode)
+    : m_filename(filename), m_reader(new VideoReader(filename)), m_mode(mode)
+{
+    m_regionW = m_uploadedW = width();
+    m_regionH = m_uploadedH = height();
+    m_shown = av_frame_alloc();
+
+    const AVPixelFormat output = negotiateFormat(*m_reader);
+    for (const auto& format : UPLOAD_FORMATS)
+    {
+        if (format.pixFmt == output)
+        {
+            m_format = format.format;
+            m_bytesPerPixel = format.bytesPerPixel;
+        }
+    }
+
+    if (mode != UploadMode::TexImage)
+    {
+        m_streamer = new TextureStreamer();
+        m_streamer->resize(width(), height());
+        m_streamer->setFormat(m_format, m_bytesPerPixel);
+        return;
+    }
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
+
+VideoStream::~VideoStream()
+{
+    if (m_texture)
+        glDeleteTextures(1, &m_texture);
+    delete m_streamer;
+    av_frame_free(&m_shown);
+    delete m_reader;
+}
+
+AVPixelFormat VideoStream::negotiateFormat(VideoReader& reader)
+{
+    AVPixelFormat accepted[std::size(UPLOAD_FORMATS)];
+    for (size_t i = 0; i < std::size(UPLOAD_FORMATS); i++)
+        accepted[i] = UPLOAD_FORMATS[i].pixFmt;
+    return reader.video_reader_set_output_formats(accepted, (int)std::size(accepted));
+}
+
+bool VideoStream::preload(ClipStore::Format format, size_t maxBytes)
+{
+    GLenum compressedFormat = 0;
+    int blockBytes = 0;
+    if (format == ClipStore::Format::BC1)
+    {
+        if (!GLAD_GL_EXT_texture_compression_s3tc)
+        {
+            printf("BC1 textures need EXT_texture_compression_s3tc\n");
+            return false;
+        }
+        compressedFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        blockBytes = (int)bcn::blockBytes(bcn::Format::BC1);
+    }
+    else if (format == ClipStore::Format::BC7)
+    {
+        if (!GLAD_GL_VERSION_4_2 && !GLAD_GL_ARB_texture_compression_bptc)
+        {
+            printf("BC7 textures need GL 4.2 or ARB_texture_compression_bptc\n");
+            return false;
+        }
+        compressedFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+        blockBytes = (int)bcn::blockBytes(bcn::Format::BC7);
+    }
+
+    // a reader of its own, so a clip that doesn't fit leaves this one untouched
+    VideoReader reader(m_filename.c_str());
+    if (compressedFormat)
+    {
+        const AVPixelFormat rgb0 = AV_PIX_FMT_RGB0;
+        reader.video_reader_set_output_formats(&rgb0, 1);
+    }
+    else
+    {
+        negotiateFormat(reader);
+    }
+    reader.video_reader_set_convert_pool(m_convertPool);
+    auto clip = std::make_unique<ClipStore>();
+    if (!clip->load(reader, format, maxBytes, m_convertPool))
+        return false;
+
+    m_compressedFormat = compressedFormat;
+    if (m_streamer)
+        m_streamer->setCompressed(compressedFormat, blockBytes);
+
+    av_frame_unref(m_shown);
+    m_hasShown = false;
+    m_clip = std::move(clip);
+    m_clipIndex = SIZE_MAX;
+    m_clipNextTime = 0.0;
+    m_framesDecoded = m_clip->frames();
+    return true;
+}
+
+void VideoStream::setRegion(int x, int y, int w, int h)
+{
+    if (x == m_regionX && y == m_regionY && w == m_regionW && h == m_regionH)
+        return;
+    m_regionX = x;
+    m_regionY = y;
+    m_regionW = w;
+    m_regionH = h;
+    m_regionDirty = true;
+}
+
+bool VideoStream::decodeNext()
+{
+    if (m_eof)
+        return false;
+    if (!m_reader->video_reader_decode_frame())
+    {
+        m_eof = true;
+        return false;
+    }
+    // media time starts with the first frame, whatever the stream's start time is
+    double time = *m_reader->pts * av_q2d(m_reader->videoReaderState.time_base);
+    if (m_framesDecoded == 0)
+        m_origin = time;
+    time -= m_origin;
+    if (m_framesDecoded > 0 && time > m_pendingTime)
+        m_frameInterval = time - m_pendingTime;
+    m_pendingTime = time;
+    m_pending = true;
+    m_framesDecoded++;
+    return true;
+}
+
+bool VideoStream::update(double time)
+{
+    if (m_clip)
+        return updateClip(time);
+
+    bool uploaded = false;
+    // a new region while paused needs the shown frame converted again
+    if (m_regionDirty && m_hasShown && m_mode == UploadMode::Pbo)
+    {
+        upload();
+        uploaded = true;
+    }
+    m_regionDirty = false;
+
+    while (true)
+    {
+        if (!m_pending && !decodeNext())
+            break;
+        if (m_pendingTime > time)
+            break;
+
+        // the frame is due; skip the upload if its successor is due as well
+        m_pending = false;
+        if (m_frameInterval > 0.0 && m_pendingTime + m_frameInterval <= time && !m_eof)
+        {
+            m_framesDropped++;
+            continue;
+        }
+        av_frame_unref(m_shown);
+        m_hasShown = av_frame_ref(m_shown, m_reader->videoReaderState.av_frame) >= 0;
+        upload();
+        uploaded = true;
+    }
+    return uploaded;
+}
+
+bool VideoStream::updateClip(double time)
+{
+    const double duration = m_clip->duration();
+    const double loopStart = std::floor(std::max(time, 0.0) / duration) * duration;
+    const size_t index = m_clip->frameAt(time - loopStart);
+    m_clipNextTime = loopStart + (index + 1 < m_clip->frames() ? m_clip->frameTime(index + 1) : duration);
+
+    const bool regionDirty = m_regionDirty && m_mode == UploadMode::Pbo;
+    m_regionDirty = false;
+    if (index == m_clipIndex && !regionDirty)
+        return false;
+    if (m_clipIndex != SIZE_MAX && index != m_clipIndex)
+        m_framesDropped += (index + m_clip->frames() - m_clipIndex - 1) % m_clip->frames();
+    m_clipIndex = index;
+
+    if (m_clip->compressed())
+    {
+        uploadCompressed(index);
+        return true;
+    }
+    av_frame_unref(m_shown);
+    m_clip->frame(index, m_shown);
+    m_hasShown = true;
+    upload();
+    return true;
+}
+
+// Block compressed clip frames go to the texture as they are, always whole.
+void VideoStream::uploadCompressed(size_t index)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (m_streamer)
+    {
+        m_streamer->upload(m_clip->data(index));
+    }
+    else
+    {
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, m_compressedFormat, width(), height(), 0,
+                               (GLsizei)m_clip->frameBytes(), m_clip->data(index));
+    }
+    m_bytesCopied = m_clip->frameBytes();
+    m_uploadedW = width();
+    m_uploadedH = height();
+    recordUploadTime(start);
+}
+
+void VideoStream::recordUploadTime(Uint64 start)
+{
+    m_lastUploadMs = 1000.0 * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    m_avgUploadMs = m_avgUploadMs == 0.0 ? m_lastUploadMs : m_avgUploadMs * 0.95 + m_lastUploadMs * 0.05;
+}
+
+void VideoStream::upload()
+{
+    const size_t frameBytes = (size_t)width() * height() * m_bytesPerPixel;
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (m_mode == UploadMode::Pbo)
+    {
+        int x = m_regionX, y = m_regionY, w = m_regionW, h = m_regionH;
+        m_reader->video_reader_align_region(&x, &y, &w, &h);
+        if (w <= 0 || h <= 0)
+            return;
+        int stride;
+        uint8_t* dst = m_streamer->beginUpload(x, y, w, h, &stride);
+        if (!dst)
+            return;
+        m_bytesCopied = convertShown(dst, stride, x, y, w, h);
+        m_streamer->endUpload();
+        m_uploadedW = w;
+        m_uploadedH = h;
+    }
+    else
+    {
+        m_bytesCopied = convertShown(m_reader->frame_buffer, width() * m_bytesPerPixel, 0, 0, width(), height());
+        if (m_mode == UploadMode::PboCopy)
+        {
+            m_streamer->upload(m_reader->frame_buffer);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, m_texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width(), height(), 0, m_format,
+                         GL_UNSIGNED_BYTE, m_reader->frame_buffer);
+        }
+        m_bytesCopied += frameBytes;
+    }
+    recordUploadTime(start);
+}
+
+// Converts the aligned region of the shown frame into `dst`, returns the bytes
+// written by the CPU.
+size_t VideoStream::convertShown(uint8_t* dst, int stride, int x, int y, int w, int h)
+{
+    uint8_t* dest[4] = { dst, nullptr, nullptr, nullptr };
+    int dest_linesize[4] = { stride, 0, 0, 0 };
+    if (m_reader->video_reader_convert_region(m_hasShown ? m_shown : nullptr, x, y, w, h, dest, dest_linesize))
+        return m_reader->bytes_converted;
+
+    // formats that can't be cropped: convert all of it and copy the region out
+    if (x == 0 && y == 0 && w == width() && h == height())
+    {
+        m_reader->video_reader_convert_frame(dest, dest_linesize);
+        return m_reader->bytes_converted;
+    }
+    uint8_t* full[4] = { m_reader->frame_buffer, nullptr, nullptr, nullptr };
+    int full_linesize[4] = { width() * m_bytesPerPixel, 0, 0, 0 };
+    m_reader->video_reader_convert_frame(full, full_linesize);
+    for (int row = 0; row < h; row++)
+        memcpy(dst + (size_t)row * stride,
+               m_reader->frame_buffer + (size_t)(y + row) * full_linesize[0] + (size_t)x * m_bytesPerPixel,
+               (size_t)w * m_bytesPerPixel);
+    return m_reader->bytes_converted + (size_t)w * h * m_bytesPerPixel;
+}
+
+const char* VideoStream::sourceFormatName() const
+{
+    return av_get_pix_fmt_name((AVPixelFormat)m_reader->videoReaderState.av_codec_ctx->pix_fmt);
+}
+
+const char* VideoStream::outputFormatName() const
+{
+    return av_get_pix_fmt_name(m_reader->videoReaderState.output_pix_fmt);
+}
+
+const char* VideoStream::uploadModeName(UploadMode mode)
+{
+    switch (mode)
+    {
+    case UploadMode::TexImage: return "teximage";
+    case UploadMode::PboCopy: return "pbo-copy";
+    case UploadMode::Pbo: return "pbo";
+    }
+    return "?";
+}
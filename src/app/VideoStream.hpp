@@ -0,0 +1,138 @@
+#pragma once
+
+#include "glad/glad.h"
+#include <cmath>
+#include "TextureStreamer.hpp"
+#include "SDL2/SDL.h"
+#include "src/decoder/clip_store.hpp"
+#include "src/decoder/video_reader.hpp"
+#include "src/decoder/worker_pool.hpp"
+
+#include <memory>
+#include <string>
+
+// A video file presented against a media clock.
+//
+// update() decodes frames until it reaches the one that is due at the given
+// time and uploads it to the stream's texture. Frames that are already late
+// when they come out of the decoder are dropped without being converted or
+// uploaded. By default a due frame is converted straight into a mapped PBO.
+//
+// With a region set (see setRegion) only that part of the frame is converted
+// and uploaded into the matching part of the texture, so a zoomed-in view
+// costs in proportion to what is visible. The shown frame is kept referenced
+// to redo the conversion when the region changes while paused.
+//
+// A preloaded stream (see preload) plays from a ClipStore instead and loops
+// forever: presenting a frame is a conversion or copy from memory, with no
+// demuxing or decoding, and the loop point is just another frame.
+class VideoStream {
+public:
+    enum class UploadMode {
+        TexImage, // convert into the reader's frame buffer, glTexImage2D from there
+        PboCopy,  // convert into the reader's frame buffer, copy into a PBO
+        Pbo,      // convert into a PBO
+    };
+
+    explicit VideoStream(const char* filename, UploadMode mode = UploadMode::Pbo);
+    ~VideoStream();
+    VideoStream(const VideoStream&) = delete;
+    VideoStream& operator=(const VideoStream&) = delete;
+
+    // returns true if a new frame was uploaded
+    bool update(double time);
+
+    // Decodes the whole file into memory and loops it from then on. Returns
+    // false if it takes more than maxBytes or a compressed format isn't
+    // supported, the stream then keeps playing from the file. BC1/BC7 clips
+    // are compressed on the convert pool and uploaded as compressed textures.
+    bool preload(ClipStore::Format format, size_t maxBytes);
+    const ClipStore* clip() const { return m_clip.get(); }
+
+    // Part of the frame, in source pixels, that is on screen; the rest of the
+    // texture keeps stale content. Only used in Pbo mode, the other modes
+    // always upload whole frames.
+    void setRegion(int x, int y, int w, int h);
+    // Converts large frames in bands on `pool`, see
+    // VideoReader::video_reader_set_convert_pool
+    void setConvertPool(WorkerPool* pool)
+    {
+        m_convertPool = pool;
+        m_reader->video_reader_set_convert_pool(pool);
+    }
+    int convertBands() const { return m_reader->bands_converted; }
+
+    // the region of the last upload after alignment
+    int regionWidth() const { return m_uploadedW; }
+    int regionHeight() const { return m_uploadedH; }
+
+    GLuint texture() const { return m_streamer ? m_streamer->texture() : m_texture; }
+    int width() const { return m_reader->videoReaderState.width; }
+    int height() const { return m_reader->videoReaderState.height; }
+    bool finished() const { return !m_clip && m_eof && !m_pending; }
+    // media time at which update() will have a new frame to show,
+    // infinity once the file is finished
+    double nextFrameTime() const { return m_clip ? m_clipNextTime : m_pending ? m_pendingTime : INFINITY; }
+    uint64_t framesDecoded() const { return m_framesDecoded; }
+    uint64_t framesDropped() const { return m_framesDropped; }
+
+    UploadMode uploadMode() const { return m_mode; }
+    static const char* uploadModeName(UploadMode mode);
+    // render thread time spent uploading a frame
+    double lastUploadMs() const { return m_lastUploadMs; }
+    double avgUploadMs() const { return m_avgUploadMs; }
+    uint64_t pbosOrphaned() const { return m_streamer ? m_streamer->orphaned() : 0; }
+    const TextureStreamer* streamer() const { return m_streamer; }
+    // decoder output and upload format; the frames are only copied if the
+    // texture takes the decoder's format as it is
+    const char* sourceFormatName() const;
+    const char* outputFormatName() const;
+    bool passthrough() const { return m_reader->passed_through; }
+    // bytes the CPU wrote between decoder output and GL memory for the last
+    // frame: the conversion plus any staging copy (glTexImage2D copies too)
+    size_t bytesCopied() const { return m_bytesCopied; }
+
+private:
+    AVPixelFormat negotiateFormat(VideoReader& reader);
+    bool decodeNext();
+    bool updateClip(double time);
+    void upload();
+    void uploadCompressed(size_t index);
+    void recordUploadTime(Uint64 start);
+    size_t convertShown(uint8_t* dst, int stride, int x, int y, int w, int h);
+
+    std::string m_filename;
+    VideoReader* m_reader;
+    UploadMode m_mode;
+    TextureStreamer* m_streamer = nullptr;
+    GLuint m_texture = 0;
+    GLenum m_format = GL_RGBA; // of the uploads
+    int m_bytesPerPixel = 4;
+    WorkerPool* m_convertPool = nullptr;
+
+    // the frame decoded by the reader, not converted nor shown yet
+    bool m_pending = false;
+    double m_pendingTime = 0.0;
+    double m_frameInterval = 0.0;
+    double m_origin = 0.0;
+    bool m_eof = false;
+
+    std::unique_ptr<ClipStore> m_clip;
+    GLenum m_compressedFormat = 0; // of a block compressed clip
+    size_t m_clipIndex = SIZE_MAX; // frame on screen
+    double m_clipNextTime = 0.0;
+
+    // the frame on screen, kept for region changes; points into m_clip when
+    // preloaded
+    AVFrame* m_shown = nullptr;
+    bool m_hasShown = false;
+    int m_regionX = 0, m_regionY = 0, m_regionW = 0, m_regionH = 0;
+    bool m_regionDirty = false;
+    int m_uploadedW = 0, m_uploadedH = 0;
+
+    uint64_t m_framesDecoded = 0;
+    uint64_t m_framesDropped = 0;
+    double m_lastUploadMs = 0.0;
+    double m_avgUploadMs = 0.0;
+    size_t m_bytesCopied = 0;
+};
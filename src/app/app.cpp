@@ -1,7 +1,15 @@
 ﻿#include "ImguiRenderer.hpp"
+#include "AudioPlayer.hpp"
+#include "CpuUsage.hpp"
+#include "PlaybackClock.hpp"
+#include "StageTimer.hpp"
+#include "StreamGrid.hpp"
+#include "VideoStream.hpp"
 #include "glad/glad.h"
 #include <SDL2/SDL.h>
 #include "widgets/FileDialog.hpp"
+#include "widgets/Timeline.hpp"
+#include "widgets/VideoView.hpp"
 #include "src/decoder/audio_demux_decode.hpp"
 #include "src/decoder/video_reader.hpp"
 
@@ -9,6 +17,12 @@
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 
 #include <map>
@@ -22,8 +36,116 @@ static const std::map<std::string, int> ffmpegToSDLAudioFmtMap = {
     {"f32le", AUDIO_F32LSB},
 };
 
+// How long the main loop may sleep when nothing needs rendering: until the
+// next video frame is due or, while the file dialog is open, a short while.
+// Audio is kept queued by the player's own thread. -1 = until input.
+static int idleWaitMs(const VideoStream *video, const StreamGrid *grid, const PlaybackClock &clock, bool dialogOpen)
+{
+    double wait = INFINITY;
+    if (video != nullptr && !clock.paused())
+        wait = std::min(wait, (video->nextFrameTime() - clock.time()) * 1000.0 / clock.speed());
+    if (grid != nullptr && !clock.paused())
+        wait = std::min(wait, (grid->nextFrameTime() - clock.time()) * 1000.0 / clock.speed());
+    if (dialogOpen)
+        wait = std::min(wait, 100.0);
+    if (wait == INFINITY)
+        return -1;
+    return (int)std::clamp(std::ceil(wait), 1.0, 1000.0);
+}
+
 int main(int argv, char **args)
 {
+    // Audio output configuration
+    // --audio-buffer <frames>: size of the device buffer, smaller is lower latency
+    // --audio-lead <ms>: how much audio is queued in front of the device
+    // --resample-quality fast|medium|high: used when the device rate differs from the file
+    // --upload teximage|pbo-copy|pbo: how video frames get into their texture
+    // --no-idle: render every vsync instead of sleeping until something changes
+    // --threads <n>: decode and conversion threads shared by all videos, default one per core
+    // --preload native|rgb|bc1|bc7: decode an opened file into memory once and loop it,
+    //   keeping frames as decoded, converted for upload or block compressed
+    // --preload-limit <MiB>: largest clip kept in memory, bigger files play from disk
+    // --preview-cache <MiB>: file dialog thumbnails kept on disk between runs, 0 = none
+    // --preview-upload <KiB>, --preview-upload-ms <ms>: most file dialog thumbnails turned
+    //   into textures in one frame, by size and by time (defaults 1024 KiB, 2 ms)
+    // --headless <frames>: render that many frames offscreen into a framebuffer object as
+    //   fast as possible, with media time advancing 1/60 s per frame, then print how long
+    //   every stage of the loop took and exit. Needs an SDL with the offscreen video driver
+    //   (EGL, e.g. Mesa llvmpipe), so it runs without a display
+    // file...: files to open side by side in the grid view; with --headless a single
+    //   file is opened as the video instead
+    int audioBufferFrames = 512;
+    double audioLeadMs = 30.0;
+    Resampler::Quality resampleQuality = Resampler::Quality::Medium;
+    VideoStream::UploadMode uploadMode = VideoStream::UploadMode::Pbo;
+    bool idle = true;
+    int decodeThreads = 0;
+    bool preload = false;
+    ClipStore::Format preloadFormat = ClipStore::Format::Native;
+    size_t preloadLimit = (size_t)512 << 20;
+    int headlessFrames = 0;
+    size_t previewCacheLimit = (size_t)256 << 20;
+    size_t previewUploadBytes = (size_t)1024 << 10;
+    double previewUploadMs = 2.0;
+    std::vector<std::string> gridFiles;
+    for (int i = 1; i < argv; i++)
+    {
+        if (!strcmp(args[i], "--no-idle"))
+            idle = false;
+        else if (args[i][0] != '-')
+            gridFiles.push_back(args[i]);
+        else if (i + 1 >= argv)
+            break;
+        else if (!strcmp(args[i], "--threads"))
+            decodeThreads = std::max(0, atoi(args[++i]));
+        else if (!strcmp(args[i], "--audio-buffer"))
+            audioBufferFrames = std::max(64, atoi(args[++i]));
+        else if (!strcmp(args[i], "--audio-lead"))
+            audioLeadMs = std::max(0.0, atof(args[++i]));
+        else if (!strcmp(args[i], "--resample-quality"))
+        {
+            const char *q = args[++i];
+            resampleQuality = !strcmp(q, "fast") ? Resampler::Quality::Fast
+                            : !strcmp(q, "high") ? Resampler::Quality::High
+                            : Resampler::Quality::Medium;
+        }
+        else if (!strcmp(args[i], "--preload"))
+        {
+            preload = true;
+            const char *f = args[++i];
+            preloadFormat = !strcmp(f, "rgb") ? ClipStore::Format::Output
+                          : !strcmp(f, "bc1") ? ClipStore::Format::BC1
+                          : !strcmp(f, "bc7") ? ClipStore::Format::BC7
+                          : ClipStore::Format::Native;
+        }
+        else if (!strcmp(args[i], "--headless"))
+            headlessFrames = std::max(1, atoi(args[++i]));
+        else if (!strcmp(args[i], "--preview-cache"))
+            previewCacheLimit = (size_t)std::max(0, atoi(args[++i])) << 20;
+        else if (!strcmp(args[i], "--preview-upload"))
+            previewUploadBytes = (size_t)std::max(0, atoi(args[++i])) << 10;
+        else if (!strcmp(args[i], "--preview-upload-ms"))
+            previewUploadMs = std::max(0.0, atof(args[++i]));
+        else if (!strcmp(args[i], "--preload-limit"))
+            preloadLimit = (size_t)std::max(1, atoi(args[++i])) << 20;
+        else if (!strcmp(args[i], "--upload"))
+        {
+            const char *m = args[++i];
+            uploadMode = !strcmp(m, "teximage") ? VideoStream::UploadMode::TexImage
+                       : !strcmp(m, "pbo-copy") ? VideoStream::UploadMode::PboCopy
+                       : VideoStream::UploadMode::Pbo;
+        }
+    }
+
+    const bool headless = headlessFrames > 0;
+    if (headless)
+    {
+        // no display and no sound card needed; drivers set in the environment still win
+        SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+        idle = false;
+    }
+
     // Setup SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
     {
@@ -31,63 +153,229 @@ int main(int argv, char **args)
         return -1;
     }
 
-    // GL 3.0 + GLSL 130
-    const char *glsl_version = "#version 130";
+    // GL 3.3 + GLSL 330, fences for the streaming texture uploads need 3.2
+    const char *glsl_version = "#version 330";
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
     // Create Window
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
     auto window_flags = (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
-    SDL_Window *window = SDL_CreateWindow("Dear ImGui SDL2+OpenGL3 example", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, window_flags);
+    if (headless)
+        window_flags = (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    SDL_Window *window = SDL_CreateWindow("Dear ImGui SDL2+OpenGL3 example", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                          headless ? 1280 : 800, headless ? 720 : 600, window_flags);
+    if (window == nullptr)
+    {
+        printf("Error: %s\n", SDL_GetError());
+        return -1;
+    }
 
     SDL_GLContext gl_context = SDL_GL_CreateContext(window);
     SDL_GL_MakeCurrent(window, gl_context);
-    SDL_GL_SetSwapInterval(1); // Enable vsync
+    SDL_GL_SetSwapInterval(headless ? 0 : 1); // Enable vsync
 
     if (!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress)) // tie window context to glad's opengl funcs
     {
         return -1;
     }
 
-    ImguiRenderer myimgui{window, glsl_version};
+    // Headless frames go into a framebuffer object of the window's size
+    // instead of the (invisible) default framebuffer, so what gets measured
+    // is rendering, not whatever the driver does on swap
+    GLuint headlessFbo = 0, headlessColor = 0;
+    if (headless)
+    {
+        int width, height;
+        SDL_GL_GetDrawableSize(window, &width, &height);
+        glGenRenderbuffers(1, &headlessColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, headlessColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenFramebuffers(1, &headlessFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, headlessFbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headlessColor);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            printf("Error: incomplete headless framebuffer\n");
+            return -1;
+        }
+        glViewport(0, 0, width, height);
+        printf("Rendering %d frames headless at %dx%d on %s\n", headlessFrames, width, height,
+               (const char *)glGetString(GL_RENDERER));
+    }
+
+    // platform windows would be real windows outside the framebuffer
+    ImguiRenderer myimgui{window, glsl_version, !headless};
 
     Widgets::FileDialog fileDialog{"Pick a video file"};
+    fileDialog.setPreviewCache(Widgets::FileDialog::defaultCacheDirectory(), previewCacheLimit);
+    fileDialog.setProbeCache(Widgets::FileDialog::defaultCacheDirectory());
+    fileDialog.setPreviewUploadBudget(previewUploadBytes, previewUploadMs);
 
     bool done = false;
 
-    SDL_AudioSpec audio_spec; // the specs of our piece of music
+    AudioPlayer audioPlayer;
+    PlaybackClock clock;
+    float speed = 1.0f;
+
+    VideoStream *video = nullptr;
+
+    // grid streams are decoded and large frames converted in bands on one
+    // shared pool, created on first use
+    std::unique_ptr<WorkerPool> decodePool;
+    auto sharedPool = [&]() -> WorkerPool & {
+        if (!decodePool)
+            decodePool = std::make_unique<WorkerPool>(decodeThreads);
+        return *decodePool;
+    };
+    std::unique_ptr<StreamGrid> grid;
+    bool gridDialog = false;
+    auto openGrid = [&](const std::vector<std::string> &files) {
+        grid.reset();
+        grid = std::make_unique<StreamGrid>(sharedPool());
+        for (const auto &file : files)
+            grid->add(file);
+        clock.reset();
+        clock.play();
+    };
+
+    // waveform of the loaded file, built while its audio is decoded
+    PeakIndex peaks;
+    Widgets::Timeline timeline;
+    Widgets::VideoView videoView;
+    size_t peakLevels = 0;
+    double peakBuildMs = 0.0;
+
+    // Opens the file as the video, with its audio and waveform; false if the
+    // audio can't be played
+    auto openVideo = [&](const char *filePath) -> bool {
+        printf("Received Path\n %s", filePath);
+        auto adec = new AudioDecoder();
+        adec->setPeakIndexPath("./audio.peaks");
+        const bool decoded = adec->demuxDecode(filePath, "./audio.raw") == 0;
+        peaks.close();
+        if (const PeakIndexBuilder *builder = adec->getPeakIndex())
+        {
+            peakLevels = builder->levels();
+            peakBuildMs = builder->buildMs();
+            peaks.open("./audio.peaks");
+        }
+
+        //Check if audio format is supported
+        const std::string& formatStr = adec->getFormat();
+        auto it = ffmpegToSDLAudioFmtMap.find(formatStr);
+        if(decoded && it != ffmpegToSDLAudioFmtMap.end()) {
+            int format = (*it).second;
+            int numOfChannels = adec->getNumChannels();
+            int sampleRate = adec->getSampleRate();
+
+            std::cout << formatStr << std::endl;
+            std::cout << sampleRate << std::endl;
+            std::cout << numOfChannels << std::endl;
+            std::string path{"audio.raw"};
+            std::ifstream f(path, std::ios::in | std::ios::binary);
+            // Obtain the size of the file.
+            const auto sz = std::filesystem::file_size(path);
+
+            // Read the whole file into the buffer.
+            std::string audio_buffer(sz, '\0');
+            f.read(audio_buffer.data(), sz);
+
+            if (!audioPlayer.load(std::move(audio_buffer), format, sampleRate, numOfChannels, audioBufferFrames, audioLeadMs,
+                                  resampleQuality))
+            {
+                delete adec;
+                return false;
+            }
+            // Play audio
+            audioPlayer.setPaused(false);
+        } else {
+            // no playable audio, don't keep playing the previous file's
+            printf("No playable audio in %s\n", filePath);
+            audioPlayer.close();
+        }
+        delete adec;
+        delete video;
+        video = new VideoStream(filePath, uploadMode);
+        video->setConvertPool(&sharedPool());
+        if (preload && !video->preload(preloadFormat, preloadLimit))
+            printf("Playing %s from disk\n", filePath);
+        videoView = Widgets::VideoView();
+        clock.reset();
+        clock.play();
+        return true;
+    };
+    if (headless && gridFiles.size() == 1)
+    {
+        if (!openVideo(gridFiles[0].c_str()))
+            return -1;
+        gridFiles.clear();
+    }
+    if (!gridFiles.empty())
+        openGrid(gridFiles);
 
-    SDL_zero(audio_spec);
-    
+    // Idle mode: rather than rendering every vsync the loop sleeps in
+    // SDL_WaitEventTimeout until input arrives or the next video frame is due,
+    // and only renders when something can have changed on screen. ImGui needs a couple of frames to settle after
+    // input (hover, popups), hence the frames still rendered after an event.
+    constexpr int SETTLE_FRAMES = 3;
+    int settleFrames = SETTLE_FRAMES;
+    int waitMs = 0; // -1 waits for input only
+    CpuUsage cpu;
 
-    VideoReader *vr = nullptr;
+    enum Stage { StageEvents, StageDecode, StageBuildUi, StageRenderUi, StageFinish };
+    std::unique_ptr<StageTimer> stages;
+    if (headless)
+        stages = std::make_unique<StageTimer>(std::vector<std::string>{
+            "events", "decode+upload", "build ui", "render ui", "gpu finish"});
+    int frame = 0;
+    const Uint64 loopStart = SDL_GetPerformanceCounter();
 
-    GLuint tex_handle;
-    glGenTextures(1, &tex_handle);
-    glBindTexture(GL_TEXTURE_2D, tex_handle);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
     while (!done)
     {
+        if (stages)
+            stages->beginFrame();
         // Poll and handle events (inputs, window resize, etc.)
         SDL_Event event;
-        while (SDL_PollEvent(&event))
+        bool gotEvent = (idle && settleFrames <= 0 && waitMs != 0)
+                            ? (waitMs < 0 ? SDL_WaitEvent(&event) : SDL_WaitEventTimeout(&event, waitMs)) != 0
+                            : SDL_PollEvent(&event) != 0;
+        while (gotEvent)
         {
             ImGui_ImplSDL2_ProcessEvent(&event);
             if (event.type == SDL_QUIT)
                 done = true;
             if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE && event.window.windowID == SDL_GetWindowID(window))
                 done = true;
+            // a grid frame finished decoding, that alone doesn't need the extra frames
+            if (event.type != StreamGrid::wakeEvent())
+                settleFrames = SETTLE_FRAMES;
+            gotEvent = SDL_PollEvent(&event) != 0;
+        }
+        cpu.update();
+        if (stages)
+            stages->mark(StageEvents);
+
+        // Decode up to the frame that is due; the texture is only touched if it changed.
+        // Headless runs step the media time by a fixed amount so runs are comparable
+        const double mediaTime = headless ? frame / 60.0 : clock.time();
+        bool newFrame = video != nullptr && video->update(mediaTime);
+        if (grid)
+            newFrame = grid->update(mediaTime) || newFrame;
+        if (stages)
+            stages->mark(StageDecode);
+
+        // the file dialog loads previews in the background, it is redrawn on the timer
+        if (idle && settleFrames <= 0 && !newFrame && !fileDialog.isOpen())
+        {
+            waitMs = idleWaitMs(video, grid.get(), clock, fileDialog.isOpen());
+            continue;
         }
+        settleFrames = std::max(settleFrames - 1, 0);
 
         glClear(GL_COLOR_BUFFER_BIT);
         myimgui.NewFrame();
@@ -98,86 +386,162 @@ int main(int argv, char **args)
                 if (ImGui::MenuItem("Open", "Ctrl+O"))
                 {
                     std::cout << "open File Dialog" << std::endl;
+                    gridDialog = false;
                     fileDialog.openDialog();
                 }
+                if (ImGui::MenuItem("Open Grid..."))
+                {
+                    gridDialog = true;
+                    fileDialog.openDialog(true);
+                }
                 ImGui::EndMenu();
             }
             ImGui::EndMainMenuBar();
         }
         // Render filedialog and then check if file selected
-        if (fileDialog.draw())
+        const bool picked = fileDialog.draw() && !fileDialog.selected().empty();
+        if (picked && gridDialog)
         {
-            const char *filePath = (char *)fileDialog.selected()[0].c_str();
-            printf("Received Path\n %s", filePath);
-            auto adec = new AudioDecoder();
-            adec->demuxDecode(filePath, "./audio.raw");
-
-            //Check if audio format is supported
-            const std::string& formatStr = adec->getFormat();
-            auto it = ffmpegToSDLAudioFmtMap.find(formatStr);
-            if(it != ffmpegToSDLAudioFmtMap.end()) {
-                int format = (*it).second;
-                int numOfChannels = adec->getNumChannels();
-                int sampleRate = adec->getSampleRate();
-
-                std::cout << formatStr << std::endl;
-                std::cout << sampleRate << std::endl;
-                std::cout << numOfChannels << std::endl;
-                int frame_size = 4;
-                if(formatStr.starts_with("s16"))
-                    frame_size = 2;
-                std::string path{"audio.raw"};
-                std::ifstream f(path, std::ios::in | std::ios::binary);
-                // Obtain the size of the file.
-                const auto sz = std::filesystem::file_size(path);
-
-                // Create a buffer.
-                std::string audio_buffer(sz, '\0');
-
-                // Read the whole file into the buffer.
-                f.read(audio_buffer.data(), sz);
-
-                int samples = (sz / frame_size) * numOfChannels;
-                
-                audio_spec.samples = samples;
-                audio_spec.freq = sampleRate;
-                audio_spec.format = format;
-                audio_spec.channels = numOfChannels;
-                auto device = SDL_OpenAudioDevice(NULL, 0, &audio_spec, nullptr, 0);
-                if (NULL == device)
-                {
-                    std::cerr << "sound device error: " << SDL_GetError() << std::endl;
-                    return -1;
-                }
-                int status = SDL_QueueAudio(device, audio_buffer.data(), sz);
-                if (status < 0)
-                {
-                    std::cerr << "sound device error: " << SDL_GetError() << std::endl;
-                    return -1;
-                }
-                // Play audio
-                SDL_PauseAudioDevice(device, 0);
+            std::vector<std::string> files;
+            for (const auto &path : fileDialog.selected())
+                files.emplace_back(reinterpret_cast<const char *>(path.c_str()));
+            openGrid(files);
+        }
+        else if (picked && !openVideo((char *)fileDialog.selected()[0].c_str()))
+            return -1;
+        // Playback controls; video frames are scheduled by the scaled clock
+        // and the audio is time-stretched to the same speed
+        if (video != nullptr || grid)
+        {
+            ImGui::Begin("Playback");
+            if (ImGui::Button(clock.paused() ? "Play" : "Pause"))
+            {
+                if (clock.paused())
+                    clock.play();
+                else
+                    clock.pause();
+                audioPlayer.setPaused(clock.paused());
             }
-            delete adec;
-            vr = new VideoReader(filePath);
+            ImGui::SameLine();
+            if (ImGui::SliderFloat("Speed", &speed, 0.5f, 3.0f, "%.2fx"))
+            {
+                clock.setSpeed(speed);
+                audioPlayer.setSpeed(speed);
+            }
+            ImGui::Text("%.2f s", clock.time());
+            if (peaks.isOpen())
+                timeline.draw(peaks, clock.time());
+            ImGui::End();
+        }
+        ImGui::Begin("Stats");
+        ImGui::Text("CPU: %.1f%% (%s)", cpu.percent(), idle ? "idle mode" : "rendering every vsync");
+        if (fileDialog.isOpen())
+        {
+            const Widgets::FileDialog::DirectoryStats directory = fileDialog.directoryStats();
+            ImGui::Text("File dialog directory: %zu entries%s, first after %.1f ms, all after %.1f ms", directory.Entries,
+                        directory.Loading ? " so far" : "", directory.FirstEntryMs, directory.TotalMs);
+            ImGui::Text("File dialog search: %zu matches in %.2f ms", directory.Matches, directory.SearchMs);
+            const Widgets::FileDialog::PreviewStats previews = fileDialog.previewStats();
+            ImGui::Text("File dialog previews: %zu loaded (%.1f/s on %zu threads), %zu queued, %zu to upload", previews.Loaded,
+                        previews.PerSecond, previews.Threads, previews.Queued, previews.Uploading);
+            ImGui::Text("Preview uploads: worst frame %.2f ms", previews.WorstUploadMs);
+            const size_t lookups = previews.CacheHits + previews.CacheMisses;
+            ImGui::Text("Preview cache: %.0f%% hits of %zu, %.1f MiB of %.0f", lookups ? 100.0 * previews.CacheHits / lookups : 0.0,
+                        lookups, previews.CacheBytes / (1024.0 * 1024.0), previewCacheLimit / (1024.0 * 1024.0));
+        }
+        ImGui::End();
+        if (audioPlayer.isOpen())
+        {
+            const AudioPlayer::Stats stats = audioPlayer.stats();
+            ImGui::Begin("Stats");
+            ImGui::Text("Audio buffer: %d frames (%.1f ms)", audioPlayer.spec().samples, stats.deviceBufferMs);
+            if (const Resampler *resampler = audioPlayer.resampler())
+                ImGui::Text("Resampling: %d -> %d Hz (%s)", resampler->inRate(), resampler->outRate(), resampler->kernelName());
+            ImGui::Text("Audio queued: %.1f ms", stats.queuedMs);
+            ImGui::Text("Audio latency: %.1f ms (avg %.1f, max %.1f)", stats.latencyMs, stats.latencyAvgMs, stats.latencyMaxMs);
+            ImGui::Text("Audio underruns: %u", stats.underruns);
+            if (peaks.isOpen())
+                ImGui::Text("Peak index: %zu levels, %.1f KiB, built in %.2f ms", peakLevels, peaks.fileSize() / 1024.0, peakBuildMs);
+            ImGui::End();
         }
         // Check if video file is selected
-        if (vr != nullptr)
+        if (video != nullptr)
         {
-            vr->video_reader_read_frame();
-            const float w = vr->videoReaderState.width;
-            const float h = vr->videoReaderState.height;
-            glBindTexture(GL_TEXTURE_2D, tex_handle);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, vr->videoReaderState.width, vr->videoReaderState.height, 0, GL_RGBA,
-                         GL_UNSIGNED_BYTE, vr->frame_buffer);
+            ImGui::Begin("Stats");
+            ImGui::Text("Video convert + upload (%s%s): %.2f ms (avg %.2f)", VideoStream::uploadModeName(video->uploadMode()),
+                        video->streamer() && video->streamer()->persistent() ? ", persistent" : "",
+                        video->lastUploadMs(), video->avgUploadMs());
+            ImGui::Text("Video format: %s %s %s", video->sourceFormatName(),
+                        video->passthrough() ? "passed through as" : "converted to", video->outputFormatName());
+            ImGui::Text("Video bytes copied: %.2f MiB per frame, converted in %d band%s", video->bytesCopied() / (1024.0 * 1024.0),
+                        video->convertBands(), video->convertBands() == 1 ? "" : "s");
+            ImGui::Text("Video frames: %llu decoded, %llu dropped, %llu pbos orphaned",
+                        (unsigned long long)video->framesDecoded(), (unsigned long long)video->framesDropped(),
+                        (unsigned long long)video->pbosOrphaned());
+            if (const ClipStore *clip = video->clip())
+            {
+                ImGui::Text("Preloaded: %zu frames %s, %.1f MiB (%.2f MiB per frame), loaded in %.0f ms, looping %.2f s",
+                            clip->frames(), clip->formatName(), clip->bytes() / (1024.0 * 1024.0),
+                            clip->frameBytes() / (1024.0 * 1024.0), clip->loadMs(), clip->duration());
+                if (clip->compressed())
+                {
+                    const double pixels = (double)clip->width() * clip->height() * clip->frames();
+                    ImGui::Text("Block compressed: %.1fx smaller than RGBA, %.1f Mpixel/s, PSNR %.2f dB",
+                                pixels * 4.0 / clip->bytes(), pixels / clip->compressMs() / 1000.0, clip->psnr());
+                }
+            }
+            ImGui::Text("Video region: %dx%d (%.0f%% of the frame, zoom %.2fx)", video->regionWidth(), video->regionHeight(),
+                        100.0 * video->regionWidth() * video->regionHeight() / ((double)video->width() * video->height()),
+                        videoView.zoom());
+            ImGui::End();
+
+            ImGui::SetNextWindowSize(ImVec2{(float)video->width(), (float)video->height()}, ImGuiCond_FirstUseEver);
             ImGui::Begin("Video");
-            ImGui::Image(reinterpret_cast<ImTextureID>(tex_handle), ImVec2{w, h});
+            videoView.draw(reinterpret_cast<ImTextureID>(video->texture()), video->width(), video->height());
+            video->setRegion(videoView.regionX(), videoView.regionY(), videoView.regionWidth(), videoView.regionHeight());
             ImGui::End();
         }
+        if (grid)
+        {
+            grid->draw();
+            grid->drawStats();
+        }
+        if (stages)
+            stages->mark(StageBuildUi);
         myimgui.Update();
+        if (stages)
+            stages->mark(StageRenderUi);
 
+        if (headless)
+        {
+            // nothing is presented, wait for the GPU so its work is counted
+            glFinish();
+            stages->mark(StageFinish);
+            if (++frame >= headlessFrames)
+                done = true;
+            continue;
+        }
         SDL_GL_SwapWindow(window);
+
+        waitMs = idleWaitMs(video, grid.get(), clock, fileDialog.isOpen());
+    }
+    if (stages)
+    {
+        const double seconds = (double)(SDL_GetPerformanceCounter() - loopStart) / (double)SDL_GetPerformanceFrequency();
+        printf("%zu frames in %.2f s, %.1f fps\n", stages->frames(), seconds, stages->frames() / seconds);
+        stages->report(stdout);
+        if (video != nullptr)
+            printf("video: %llu frames decoded, %llu dropped, convert + upload avg %.2f ms\n",
+                   (unsigned long long)video->framesDecoded(), (unsigned long long)video->framesDropped(),
+                   video->avgUploadMs());
+        if (grid)
+            printf("grid: %zu streams, %.1f frames/s decoded\n", grid->size(), grid->aggregateFps());
+        glDeleteFramebuffers(1, &headlessFbo);
+        glDeleteRenderbuffers(1, &headlessColor);
     }
+    delete video;
+    grid.reset();
+    decodePool.reset();
     myimgui.Shutdown();
 
     return 0;
@@ -1,5 +1,11 @@
 #include "FileDialog.hpp"
 #include "glad/glad.h"
+#include "src/decoder/media_probe.hpp"
+#include "src/decoder/thumbnail.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 
 namespace Widgets
 {
@@ -13,8 +19,8 @@ namespace Widgets
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // GL_NEAREST never samples mipmaps, so none are generated
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, (fmt == 0) ? GL_BGRA : GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, 0);
 
         return (void *)tex;
@@ -29,6 +35,63 @@ namespace Widgets
         };
     }
 
+    static bool isVideoFile(const std::filesystem::path &path)
+    {
+        static const char *const extensions[] = {".mp4", ".mkv", ".mov", ".avi", ".webm", ".m4v",
+                                                 ".mpg", ".mpeg", ".ts", ".flv", ".wmv", ".ogv"};
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return std::any_of(std::begin(extensions), std::end(extensions), [&](const char *e) { return ext == e; });
+    }
+
+    void FileDialog::setPreviewLoader()
+    {
+        LoadPreview = [](const std::filesystem::path &path, int size, PreviewImage &out)
+        {
+            if (!isVideoFile(path))
+                return false;
+            Thumbnail thumbnail;
+            if (!decodeThumbnail(path.string().c_str(), size, thumbnail))
+                return false;
+            out.Data = std::move(thumbnail.pixels);
+            out.Width = thumbnail.width;
+            out.Height = thumbnail.height;
+            return true;
+        };
+    }
+
+    void FileDialog::setMediaProber()
+    {
+        ProbeMedia = [](const std::filesystem::path &path, MediaInfo &out)
+        {
+            if (!isVideoFile(path))
+                return false;
+            MediaProbe probe;
+            if (!probeMedia(path.string().c_str(), probe))
+                return false;
+            out.Duration = probe.duration;
+            out.Width = probe.width;
+            out.Height = probe.height;
+            out.FrameRate = probe.frameRate;
+            out.Codec = std::move(probe.codec);
+            return true;
+        };
+    }
+
+    std::filesystem::path FileDialog::defaultCacheDirectory()
+    {
+#ifdef _WIN32
+        if (const char *local = std::getenv("LOCALAPPDATA"))
+            return std::filesystem::u8path(local) / "video-player";
+#else
+        if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+            return std::filesystem::u8path(cache) / "video-player";
+        if (const char *home = std::getenv("HOME"))
+            return std::filesystem::u8path(home) / ".cache" / "video-player";
+#endif
+        return {};
+    }
+
     bool FileDialog::draw()
     {
         bool done = IsDone(m_title);
@@ -8,12 +8,27 @@ namespace Widgets {
         FileDialog(const char* title) : m_title(title) {
             setToCurrentPath();
             setDeleteTexture();
+            setPreviewLoader();
+            setMediaProber();
         }
         virtual ~FileDialog() = default;
         void setToCurrentPath() { m_currentPath = std::filesystem::current_path(); }
-        void openDialog() {
-            Open(m_title, m_title, "*.*", false, reinterpret_cast<const char*>(m_currentPath.u8string().c_str()));
+        void openDialog(bool multiselect = false) {
+            Open(m_title, m_title, "*.*", multiselect, reinterpret_cast<const char*>(m_currentPath.u8string().c_str()));
         }
+        bool isOpen() const { return IsOpen(); }
+        using PreviewStats = ifd::FileDialog::PreviewStats;
+        PreviewStats previewStats() const { return GetPreviewStats(); }
+        using DirectoryStats = ifd::FileDialog::DirectoryStats;
+        DirectoryStats directoryStats() const { return GetDirectoryStats(); }
+        // previews kept between runs, see ifd::FileDialog::SetPreviewCache
+        void setPreviewCache(const std::filesystem::path& directory, size_t maxBytes) { SetPreviewCache(directory, maxBytes); }
+        // preview textures made per frame, see ifd::FileDialog::SetPreviewUploadBudget
+        void setPreviewUploadBudget(size_t bytes, double ms) { SetPreviewUploadBudget(bytes, ms); }
+        // duration, resolution, codec and fps kept between runs
+        void setProbeCache(const std::filesystem::path& directory) { SetProbeCache(directory); }
+        // $XDG_CACHE_HOME/video-player (~/.cache/video-player), %LOCALAPPDATA%\video-player on Windows
+        static std::filesystem::path defaultCacheDirectory();
         const std::vector<std::u8string>& selected() const { return m_results; }
         bool draw();
         std::filesystem::path m_currentPath;
@@ -22,6 +37,10 @@ namespace Widgets {
 
     private:
         void setDeleteTexture();
+        // video files get a keyframe thumbnail in the icon view
+        void setPreviewLoader();
+        // and duration, resolution, codec and frame rate columns in the table view
+        void setMediaProber();
         const char* m_title;
         std::vector<std::u8string> m_results;
     };
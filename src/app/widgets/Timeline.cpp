@@ -0,0 +1,69 @@
+#include "Timeline.hpp"
+#include "imgui.h"
+
+#include <algorithm>
+
+namespace Widgets
+{
+    void Timeline::draw(const PeakIndex& peaks, double playhead)
+    {
+        const double duration = peaks.duration();
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const ImVec2 size{std::max(ImGui::GetContentRegionAvail().x, 1.0f), 96.0f};
+        ImGui::InvisibleButton("##timeline", size);
+        if (duration <= 0.0)
+            return;
+
+        if (m_visible <= 0.0 || m_visible > duration)
+            m_visible = duration;
+        const double minVisible = std::min(duration, 16.0 / peaks.sampleRate() * size.x); // 16 frames per pixel
+        const double secondsPerPixel = m_visible / size.x;
+
+        const ImGuiIO& io = ImGui::GetIO();
+        const bool hovered = ImGui::IsItemHovered();
+        if (hovered && io.MouseWheel != 0.0f)
+        {
+            // keep the time under the cursor where it is
+            const double anchor = m_start + (io.MousePos.x - origin.x) * secondsPerPixel;
+            m_visible = std::clamp(m_visible * (io.MouseWheel > 0.0f ? 0.8 : 1.25), minVisible, duration);
+            m_start = anchor - (io.MousePos.x - origin.x) * (m_visible / size.x);
+            m_follow = false;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left))
+        {
+            m_start -= io.MouseDelta.x * secondsPerPixel;
+            m_follow = false;
+        }
+        if (hovered && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+            m_follow = true;
+        if (m_follow && (playhead < m_start || playhead > m_start + m_visible))
+            m_start = playhead - m_visible * 0.1;
+        m_start = std::clamp(m_start, 0.0, duration - m_visible);
+
+        // one column per pixel
+        const int pixels = (int)size.x;
+        peaks.query(m_start, m_start + m_visible, pixels, m_columns);
+
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        const float mid = origin.y + size.y * 0.5f;
+        const float scale = size.y * 0.5f / 32767.0f;
+        drawList->AddRectFilled(origin, ImVec2{origin.x + size.x, origin.y + size.y}, IM_COL32(20, 20, 24, 255));
+        for (int x = 0; x < pixels; x++)
+        {
+            const Peak& p = m_columns[x];
+            const float px = origin.x + x;
+            drawList->AddRectFilled(ImVec2{px, mid - p.max * scale}, ImVec2{px + 1.0f, mid - p.min * scale + 1.0f},
+                                    IM_COL32(70, 130, 200, 255));
+            drawList->AddRectFilled(ImVec2{px, mid - p.rms * scale}, ImVec2{px + 1.0f, mid + p.rms * scale + 1.0f},
+                                    IM_COL32(140, 190, 240, 255));
+        }
+
+        const float head = origin.x + (float)((playhead - m_start) / m_visible * size.x);
+        if (head >= origin.x && head <= origin.x + size.x)
+            drawList->AddLine(ImVec2{head, origin.y}, ImVec2{head, origin.y + size.y}, IM_COL32(240, 80, 60, 255), 2.0f);
+
+        ImGui::Text("%.2f - %.2f s of %.2f s%s", m_start, m_start + m_visible, duration,
+                    m_follow ? "" : "  (double-click to follow the playhead)");
+    }
+
+} // namespace Widgets
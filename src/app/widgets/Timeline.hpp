@@ -0,0 +1,22 @@
+#pragma once
+
+#include "src/decoder/peak_index.hpp"
+#include <vector>
+
+namespace Widgets {
+
+    // Waveform of the whole file drawn from a PeakIndex, with the playhead.
+    // The mouse wheel zooms around the cursor and dragging pans, a double-click
+    // makes the view follow the playhead again. Every frame costs one
+    // PeakIndex::query for the visible pixels, whatever the file length.
+    class Timeline {
+    public:
+        void draw(const PeakIndex& peaks, double playhead);
+
+    private:
+        double m_start = 0.0;   // seconds at the left edge
+        double m_visible = 0.0; // seconds across the width, 0 = whole file
+        bool m_follow = true;
+        std::vector<Peak> m_columns;
+    };
+} // Widgets
@@ -0,0 +1,69 @@
+#include "VideoView.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Widgets
+{
+    void VideoView::draw(ImTextureID texture, int width, int height)
+    {
+        const ImVec2 avail = ImGui::GetContentRegionAvail();
+        if (width <= 0 || height <= 0 || avail.x < 1.0f || avail.y < 1.0f)
+        {
+            // collapsed: upload whole frames as before
+            m_regionX = m_regionY = 0;
+            m_regionW = width;
+            m_regionH = height;
+            return;
+        }
+
+        // fit the frame, keeping its aspect ratio
+        const float fit = std::min(avail.x / width, avail.y / height);
+        const ImVec2 size{width * fit, height * fit};
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImGui::InvisibleButton("##video", size);
+
+        const ImGuiIO& io = ImGui::GetIO();
+        const bool hovered = ImGui::IsItemHovered();
+        float visible = 1.0f / m_zoom; // fraction of the frame across the view
+        if (hovered && io.MouseWheel != 0.0f)
+        {
+            // keep the pixel under the cursor where it is
+            const float cx = (io.MousePos.x - origin.x) / size.x - 0.5f;
+            const float cy = (io.MousePos.y - origin.y) / size.y - 0.5f;
+            const float anchorX = m_centerX + cx * visible;
+            const float anchorY = m_centerY + cy * visible;
+            m_zoom = std::clamp(m_zoom * (io.MouseWheel > 0.0f ? 1.25f : 0.8f), 1.0f, 64.0f);
+            visible = 1.0f / m_zoom;
+            m_centerX = anchorX - cx * visible;
+            m_centerY = anchorY - cy * visible;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left))
+        {
+            m_centerX -= io.MouseDelta.x / size.x * visible;
+            m_centerY -= io.MouseDelta.y / size.y * visible;
+        }
+        if (hovered && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+        {
+            m_zoom = 1.0f;
+            visible = 1.0f;
+        }
+        m_centerX = std::clamp(m_centerX, visible * 0.5f, 1.0f - visible * 0.5f);
+        m_centerY = std::clamp(m_centerY, visible * 0.5f, 1.0f - visible * 0.5f);
+
+        const ImVec2 uv0{m_centerX - visible * 0.5f, m_centerY - visible * 0.5f};
+        const ImVec2 uv1{m_centerX + visible * 0.5f, m_centerY + visible * 0.5f};
+        ImGui::GetWindowDrawList()->AddImage(texture, origin, ImVec2{origin.x + size.x, origin.y + size.y}, uv0, uv1);
+
+        // one texel more on each side for the bilinear filter at the edges
+        const int x0 = std::max((int)std::floor(uv0.x * width) - 1, 0);
+        const int y0 = std::max((int)std::floor(uv0.y * height) - 1, 0);
+        const int x1 = std::min((int)std::ceil(uv1.x * width) + 1, width);
+        const int y1 = std::min((int)std::ceil(uv1.y * height) + 1, height);
+        m_regionX = x0;
+        m_regionY = y0;
+        m_regionW = x1 - x0;
+        m_regionH = y1 - y0;
+    }
+
+} // namespace Widgets
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "imgui.h"
+
+namespace Widgets {
+
+    // A video texture fitted into the rest of the window. The mouse wheel zooms
+    // around the cursor and dragging pans, a double-click fits the whole frame
+    // again. region*() is the part of the frame that ended up on screen, in
+    // source pixels, so only that needs converting and uploading.
+    class VideoView {
+    public:
+        void draw(ImTextureID texture, int width, int height);
+
+        int regionX() const { return m_regionX; }
+        int regionY() const { return m_regionY; }
+        int regionWidth() const { return m_regionW; }
+        int regionHeight() const { return m_regionH; }
+        float zoom() const { return m_zoom; }
+
+    private:
+        float m_zoom = 1.0f;                 // 1 = whole frame fits
+        float m_centerX = 0.5f, m_centerY = 0.5f; // view center, in texture coordinates
+        int m_regionX = 0, m_regionY = 0, m_regionW = 0, m_regionH = 0;
+    };
+} // Widgets
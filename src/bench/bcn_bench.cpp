@@ -0,0 +1,95 @@
+// Throughput and quality of the BC1 / BC7 block encoders on a synthetic
+// frame (gradients, hard edges and noise), single threaded and on a
+// WorkerPool, with the memory saved against RGBA.
+//
+// usage: bench-bcn [width] [height] [iterations]
+
+#include "src/decoder/block_compress.hpp"
+#include "src/decoder/worker_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<uint8_t> make_frame(int width, int height)
+{
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.0f, 4.0f);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint8_t* p = &rgba[((size_t)y * width + x) * 4];
+            const float u = (float)x / width, v = (float)y / height;
+            float r = 255.0f * u, g = 255.0f * v, b = 128.0f + 127.0f * std::sin(u * 20.0f + v * 7.0f);
+            if (((x / 97) + (y / 61)) % 5 == 0)
+            {
+                // flat coloured patches with hard edges
+                r = 230.0f;
+                g = 40.0f;
+                b = 60.0f;
+            }
+            p[0] = (uint8_t)std::clamp(r + noise(rng), 0.0f, 255.0f);
+            p[1] = (uint8_t)std::clamp(g + noise(rng), 0.0f, 255.0f);
+            p[2] = (uint8_t)std::clamp(b + noise(rng), 0.0f, 255.0f);
+            p[3] = 255;
+        }
+    }
+    return rgba;
+}
+
+static double psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+    double sum = 0.0;
+    size_t n = 0;
+    for (size_t i = 0; i < a.size(); i += 4)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const double d = (double)a[i + c] - b[i + c];
+            sum += d * d;
+        }
+        n += 3;
+    }
+    const double mse = sum / n;
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+int main(int argc, char** argv)
+{
+    const int width = argc > 1 ? std::max(atoi(argv[1]), 1) : 1920;
+    const int height = argc > 2 ? std::max(atoi(argv[2]), 1) : 1080;
+    const int iterations = argc > 3 ? std::max(atoi(argv[3]), 1) : 10;
+
+    const std::vector<uint8_t> frame = make_frame(width, height);
+    std::vector<uint8_t> decoded(frame.size());
+    WorkerPool pool;
+    printf("frame: %dx%d, %.1f MiB of RGBA, pool of %zu threads + caller, %s kernels\n", width, height,
+           frame.size() / (1024.0 * 1024.0), pool.size(), bcn::kernelName());
+
+    for (bcn::Format format : {bcn::Format::BC1, bcn::Format::BC7})
+    {
+        std::vector<uint8_t> blocks(bcn::compressedSize(format, width, height));
+        for (WorkerPool* p : {(WorkerPool*)nullptr, &pool})
+        {
+            bcn::compress(format, frame.data(), width * 4, width, height, blocks.data(), p);
+            auto start = Clock::now();
+            for (int i = 0; i < iterations; i++)
+                bcn::compress(format, frame.data(), width * 4, width, height, blocks.data(), p);
+            const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+            printf("%s %-8s %8.2f ms/frame  %7.1f Mpixel/s\n", bcn::formatName(format), p ? "pool" : "1 thread",
+                   ms, (double)width * height / ms / 1000.0);
+        }
+        bcn::decompress(format, blocks.data(), width, height, decoded.data(), width * 4);
+        printf("%s PSNR %.2f dB, %.2f MiB (%.0fx smaller than RGBA)\n", bcn::formatName(format),
+               psnr(frame, decoded), blocks.size() / (1024.0 * 1024.0), (double)frame.size() / blocks.size());
+    }
+    return 0;
+}
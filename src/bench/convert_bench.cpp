@@ -0,0 +1,87 @@
+// Colour conversion time of one decoded frame to RGB0 with 1 .. N bands
+// converted in parallel on a WorkerPool, against a single sws_scale call.
+// Meant for large frames: a 4K or 8K clip shows how far the bands scale.
+//
+// usage: bench-convert <video file> [iterations] [max threads]
+
+#include "src/decoder/video_reader.hpp"
+#include "src/decoder/worker_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: bench-convert <video file> [iterations] [max threads]\n");
+        return 1;
+    }
+    const int iterations = argc > 2 ? std::max(atoi(argv[2]), 1) : 50;
+    const int max_threads = argc > 3 ? std::max(atoi(argv[3]), 1)
+                                     : (int)std::max(1u, std::thread::hardware_concurrency());
+
+    std::unique_ptr<VideoReader> reader;
+    try
+    {
+        reader = std::make_unique<VideoReader>(argv[1]);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    if (!reader->video_reader_decode_frame())
+    {
+        fprintf(stderr, "No frame in %s\n", argv[1]);
+        return 1;
+    }
+
+    const int width = reader->videoReaderState.width;
+    const int height = reader->videoReaderState.height;
+    const size_t frame_bytes = (size_t)width * height * 4;
+    std::vector<uint8_t> serial(frame_bytes), banded(frame_bytes);
+    uint8_t* dest[4] = { serial.data(), nullptr, nullptr, nullptr };
+    int dest_linesize[4] = { width * 4, 0, 0, 0 };
+    printf("frame:   %dx%d %s, %.1f MiB of RGB0\n", width, height,
+           av_get_pix_fmt_name((AVPixelFormat)reader->videoReaderState.av_frame->format), frame_bytes / (1024.0 * 1024.0));
+
+    double serial_ms = 0.0;
+    for (int threads = 1; threads <= max_threads; threads++)
+    {
+        // the caller converts a band too, so the pool has one thread less
+        std::unique_ptr<WorkerPool> pool;
+        if (threads > 1)
+            pool = std::make_unique<WorkerPool>(threads - 1);
+        reader->video_reader_set_convert_pool(pool.get(), threads);
+        dest[0] = threads == 1 ? serial.data() : banded.data();
+
+        reader->video_reader_convert_frame(dest, dest_linesize); // scaler contexts
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; i++)
+            reader->video_reader_convert_frame(dest, dest_linesize);
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+        if (threads == 1)
+            serial_ms = ms;
+
+        // band edges may differ slightly where chroma is interpolated
+        size_t differing = 0;
+        if (threads > 1)
+            for (size_t i = 0; i < frame_bytes; i++)
+                differing += serial[i] != banded[i];
+        printf("%2d thread%s %2d band%s  %7.2f ms  %6.0f Mpixel/s  %5.2fx  %.3f%% bytes differ\n", threads,
+               threads == 1 ? " " : "s", reader->bands_converted, reader->bands_converted == 1 ? " " : "s", ms,
+               (double)width * height / ms / 1000.0, serial_ms / ms, 100.0 * differing / frame_bytes);
+    }
+    reader->video_reader_set_convert_pool(nullptr);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Stress test for ifd::HandoffStack, the lock free list the file dialog's
+// worker threads hand results over with. Several producers push numbered
+// items while one consumer keeps taking everything pushed so far; every item
+// has to come out exactly once and each producer's items in the order they
+// were pushed. Configure with -DHANDOFF_STRESS_TSAN=ON to run it under
+// ThreadSanitizer.
+//
+// usage: bench-handoff-stress [producers] [items_per_producer] [rounds]
+
+#include "deps/ImFileDialog/ImFileDialog.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct Item {
+    int producer;
+    int seq;
+    // owned payload, so a value moved out twice or never freed shows up
+    // under the sanitizers
+    std::unique_ptr<int> check;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static bool run_round(int producers, int items)
+{
+    ifd::HandoffStack<Item> stack;
+    std::atomic<int> running{ producers };
+    std::atomic<bool> go{ false };
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p]() {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (int i = 0; i < items; ++i)
+                stack.Push(Item{ p, i, std::make_unique<int>(p ^ i) });
+            running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    std::vector<int> next(producers, 0); // next seq expected from each producer
+    std::vector<Item> taken;
+    size_t total = 0, takes = 0;
+    bool ok = true;
+    go.store(true, std::memory_order_release);
+    for (;;)
+    {
+        // read before taking, so nothing pushed before the last producer
+        // finished can be left behind
+        const bool done = running.load(std::memory_order_acquire) == 0;
+        taken.clear();
+        stack.TakeAll(taken);
+        takes++;
+        for (const Item& item : taken)
+        {
+            if (item.producer < 0 || item.producer >= producers || !item.check ||
+                *item.check != (item.producer ^ item.seq))
+            {
+                printf("corrupt item (producer %d, seq %d)\n", item.producer, item.seq);
+                ok = false;
+                continue;
+            }
+            if (item.seq != next[item.producer])
+            {
+                printf("producer %d: got seq %d, expected %d\n", item.producer, item.seq, next[item.producer]);
+                ok = false;
+            }
+            next[item.producer] = item.seq + 1;
+        }
+        total += taken.size();
+        if (done)
+            break;
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::vector<Item> left;
+    stack.TakeAll(left);
+    if (!left.empty())
+    {
+        printf("%zu items left after the producers finished\n", left.size());
+        ok = false;
+    }
+    for (int p = 0; p < producers; ++p)
+    {
+        if (next[p] != items)
+        {
+            printf("producer %d: took %d of %d items\n", p, next[p], items);
+            ok = false;
+        }
+    }
+    if (total != (size_t)producers * items)
+    {
+        printf("took %zu items, pushed %zu\n", total, (size_t)producers * items);
+        ok = false;
+    }
+    printf("  %zu items in %zu takes\n", total, takes);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 8;
+    int items = argc > 2 ? atoi(argv[2]) : 100000;
+    int rounds = argc > 3 ? atoi(argv[3]) : 10;
+    if (producers <= 0 || items <= 0 || rounds <= 0)
+    {
+        printf("usage: %s [producers] [items_per_producer] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    bool ok = true;
+    for (int round = 0; round < rounds && ok; ++round)
+    {
+        printf("round %d: %d producers x %d items\n", round + 1, producers, items);
+        auto start = Clock::now();
+        ok = run_round(producers, items);
+        printf("  %.1f ms\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    // items still queued when the stack goes away are freed by its destructor
+    {
+        ifd::HandoffStack<Item> stack;
+        for (int i = 0; i < 1000; ++i)
+            stack.Push(Item{ 0, i, std::make_unique<int>(i) });
+    }
+
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+// Build cost and size of the waveform peak index for a long stereo 48 kHz
+// stream, and the cost of querying it for a timeline at several zoom levels.
+//
+// usage: bench-peaks [minutes] [peak_file]
+
+#include "src/decoder/peak_index.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static constexpr int RATE = 48000;
+static constexpr int CHANNELS = 2;
+static constexpr size_t BLOCK = 4096; // frames handed over per decoded "frame"
+static constexpr int PIXELS = 1920;
+
+using Clock = std::chrono::steady_clock;
+
+static double ms_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    int minutes = argc > 1 ? atoi(argv[1]) : 60;
+    const char* path = argc > 2 ? argv[2] : "bench.peaks";
+    const size_t frames = (size_t)RATE * 60 * minutes;
+
+    // s16 like most decoders produce, an amplitude envelope so levels differ
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> noise(-2000, 2000);
+    std::vector<int16_t> block(BLOCK * CHANNELS);
+
+    PeakIndexBuilder builder(RATE, CHANNELS);
+    double generate_ms = 0.0;
+    for (size_t off = 0; off < frames; off += BLOCK)
+    {
+        auto start = Clock::now();
+        size_t n = std::min(BLOCK, frames - off);
+        for (size_t i = 0; i < n; i++)
+        {
+            double t = (double)(off + i) / RATE;
+            double env = 0.5 + 0.5 * std::sin(t * 0.7);
+            int16_t v = (int16_t)(env * 20000.0 * std::sin(2 * 3.14159265 * 220.0 * t));
+            block[i * CHANNELS] = (int16_t)(v + noise(rng));
+            block[i * CHANNELS + 1] = (int16_t)(v + noise(rng));
+        }
+        generate_ms += ms_since(start);
+        builder.add(block.data(), PeakIndexBuilder::SampleType::S16, n);
+    }
+    builder.finish();
+
+    const double pcm_bytes = (double)frames * CHANNELS * sizeof(int16_t);
+    const double audio_sec = (double)frames / RATE;
+    printf("audio:        %d min, stereo s16, %.1f MiB of PCM\n", minutes, pcm_bytes / (1 << 20));
+    printf("build:        %.1f ms (%.2f ms per audio minute, %.0f MiB/s of PCM)\n", builder.buildMs(),
+           builder.buildMs() / (audio_sec / 60.0), pcm_bytes / (1 << 20) / (builder.buildMs() / 1000.0));
+    printf("index:        %zu levels, %.1f KiB (%.3f%% of the PCM, %.1f KiB per audio minute)\n", builder.levels(),
+           builder.fileSize() / 1024.0, 100.0 * builder.fileSize() / pcm_bytes,
+           builder.fileSize() / 1024.0 / (audio_sec / 60.0));
+
+    auto start = Clock::now();
+    if (!builder.write(path))
+        return 1;
+    printf("write:        %.2f ms\n", ms_since(start));
+
+    PeakIndex index;
+    start = Clock::now();
+    if (!index.open(path))
+        return 1;
+    printf("open (mmap):  %.3f ms\n", ms_since(start));
+
+    printf("\n%14s %16s %12s\n", "visible [s]", "frames / pixel", "query [us]");
+    std::vector<Peak> columns;
+    for (double visible : {audio_sec, audio_sec / 10, 600.0, 60.0, 10.0, 1.0, 0.1})
+    {
+        if (visible > audio_sec)
+            continue;
+        const int reps = 200;
+        start = Clock::now();
+        for (int r = 0; r < reps; r++)
+        {
+            double t0 = std::fmod(r * 37.0, audio_sec - visible + 1e-9);
+            index.query(t0, t0 + visible, PIXELS, columns);
+        }
+        printf("%14.1f %16.1f %12.1f\n", visible, visible * RATE / PIXELS, ms_since(start) * 1000.0 / reps);
+    }
+    return 0;
+}
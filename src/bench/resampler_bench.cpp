@@ -0,0 +1,106 @@
+// Compares the polyphase Resampler against libswresample for 44.1k <-> 48k
+// stereo float conversion.
+//
+// usage: bench-resampler [seconds]
+
+extern "C" {
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+}
+
+#include "src/decoder/resampler.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static constexpr int CHANNELS = 2;
+static constexpr size_t BLOCK = 1024; // frames per call, like an audio callback
+
+static std::vector<float> make_signal(int rate, int seconds)
+{
+    // a sweep covers the whole band, which keeps the filter honest
+    std::vector<float> buf((size_t)rate * seconds * CHANNELS);
+    double phase = 0.0;
+    for (size_t i = 0; i < buf.size() / CHANNELS; i++)
+    {
+        double f = 20.0 + (rate / 2.0 - 20.0) * i / (buf.size() / CHANNELS);
+        phase += 2.0 * 3.14159265358979323846 * f / rate;
+        buf[i * CHANNELS] = (float)(0.5 * std::sin(phase));
+        buf[i * CHANNELS + 1] = (float)(0.5 * std::cos(phase));
+    }
+    return buf;
+}
+
+static void report(const char* name, int in_rate, int out_rate, size_t frames, double sec, double audio_sec)
+{
+    printf("%-22s %5d -> %5d  %8.1f ms  %7.1f Mframes/s  %6.0fx realtime\n",
+           name, in_rate, out_rate, sec * 1000.0, frames / sec / 1e6, audio_sec / sec);
+}
+
+static void bench_resampler(Resampler::Quality quality, int in_rate, int out_rate, const std::vector<float>& in)
+{
+    Resampler resampler(in_rate, out_rate, CHANNELS, quality);
+    std::vector<float> out;
+    out.reserve((size_t)((double)in.size() * out_rate / in_rate) + 4096);
+    const size_t frames = in.size() / CHANNELS;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < frames; off += BLOCK)
+        resampler.process(in.data() + off * CHANNELS, std::min(BLOCK, frames - off), out);
+    resampler.flush(out);
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char name[64];
+    snprintf(name, sizeof(name), "resampler %s/%s", Resampler::qualityName(quality), resampler.kernelName());
+    report(name, in_rate, out_rate, frames, sec, (double)frames / in_rate);
+}
+
+static void bench_swresample(int in_rate, int out_rate, const std::vector<float>& in)
+{
+    AVChannelLayout layout;
+    av_channel_layout_default(&layout, CHANNELS);
+    SwrContext* swr = NULL;
+    if (swr_alloc_set_opts2(&swr, &layout, AV_SAMPLE_FMT_FLT, out_rate, &layout, AV_SAMPLE_FMT_FLT, in_rate, 0, NULL) < 0 ||
+        swr_init(swr) < 0)
+    {
+        fprintf(stderr, "Could not initialize swresample\n");
+        swr_free(&swr);
+        return;
+    }
+
+    const size_t frames = in.size() / CHANNELS;
+    std::vector<float> out((BLOCK * out_rate / in_rate + 256) * CHANNELS);
+    uint8_t* out_ptr = reinterpret_cast<uint8_t*>(out.data());
+    const int out_count = (int)(out.size() / CHANNELS);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t off = 0; off < frames; off += BLOCK)
+    {
+        const uint8_t* in_ptr = reinterpret_cast<const uint8_t*>(in.data() + off * CHANNELS);
+        swr_convert(swr, &out_ptr, out_count, &in_ptr, (int)std::min(BLOCK, frames - off));
+    }
+    while (swr_convert(swr, &out_ptr, out_count, NULL, 0) > 0)
+        ;
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report("swresample", in_rate, out_rate, frames, sec, (double)frames / in_rate);
+    swr_free(&swr);
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 60;
+    const int rates[][2] = {{44100, 48000}, {48000, 44100}};
+
+    for (const auto& r : rates)
+    {
+        std::vector<float> in = make_signal(r[0], seconds);
+        for (auto quality : {Resampler::Quality::Fast, Resampler::Quality::Medium, Resampler::Quality::High})
+            bench_resampler(quality, r[0], r[1], in);
+        bench_swresample(r[0], r[1], in);
+    }
+    return 0;
+}
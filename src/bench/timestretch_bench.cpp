@@ -0,0 +1,57 @@
+// CPU cost of the WSOLA time stretcher for stereo 48 kHz at every speed the
+// player offers, reported per second of input and per second of output audio.
+//
+// usage: bench-timestretch [seconds]
+
+#include "src/decoder/time_stretch.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static constexpr int RATE = 48000;
+static constexpr int CHANNELS = 2;
+static constexpr size_t BLOCK = 1024;
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 60;
+
+    // a few partials plus noise, closer to music than a pure tone
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+    std::vector<float> in((size_t)RATE * seconds * CHANNELS);
+    for (size_t i = 0; i < in.size() / CHANNELS; i++)
+    {
+        double t = (double)i / RATE;
+        float v = (float)(0.3 * std::sin(2 * 3.14159265 * 220.0 * t) + 0.2 * std::sin(2 * 3.14159265 * 331.0 * t) +
+                          0.1 * std::sin(2 * 3.14159265 * 1870.0 * t));
+        in[i * CHANNELS] = v + noise(rng);
+        in[i * CHANNELS + 1] = v + noise(rng);
+    }
+
+    printf("%6s %12s %16s %17s %10s\n", "speed", "output [s]", "cpu/input s [ms]", "cpu/output s [ms]", "realtime");
+    for (double speed : {0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0})
+    {
+        TimeStretch stretch(RATE, CHANNELS);
+        stretch.setSpeed(speed);
+        std::vector<float> out;
+        out.reserve((size_t)(in.size() / speed) + RATE * CHANNELS);
+
+        const size_t frames = in.size() / CHANNELS;
+        size_t produced = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t off = 0; off < frames; off += BLOCK)
+            produced += stretch.process(in.data() + off * CHANNELS, std::min(BLOCK, frames - off), out);
+        produced += stretch.flush(out);
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double out_sec = (double)produced / RATE;
+        printf("%5.2fx %12.1f %16.2f %17.2f %9.0fx\n", speed, out_sec, sec * 1000.0 / seconds, sec * 1000.0 / out_sec,
+               out_sec / sec);
+    }
+    return 0;
+}
@@ -31,6 +31,11 @@
 
 #include "audio_demux_decode.hpp"
 
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
 static AVFormatContext *fmt_ctx = NULL;
 static AVCodecContext *audio_dec_ctx;
 static AVStream *audio_stream = NULL;
@@ -43,11 +48,53 @@ static int audio_stream_idx = -1;
 static AVFrame *frame = NULL;
 static AVPacket *pkt = NULL;
 static int audio_frame_count = 0;
+static PeakIndexBuilder *peak_builder = NULL;
+
+
+/* Size in bytes of one sample as it is written to the raw output: a single
+ * channel for planar formats (only the first plane is written), all
+ * interleaved channels for packed formats. */
+static int output_sample_size(const AVFrame *frame)
+{
+    AVSampleFormat sfmt = (AVSampleFormat)frame->format;
+    int size = av_get_bytes_per_sample(sfmt);
+    if (!av_sample_fmt_is_planar(sfmt))
+        size *= frame->ch_layout.nb_channels;
+    return size;
+}
+
+/* Sample type the peak index reads the raw output as, false if there is none */
+static bool peak_sample_type(AVSampleFormat sfmt, PeakIndexBuilder::SampleType *type)
+{
+    switch (av_get_packed_sample_fmt(sfmt))
+    {
+    case AV_SAMPLE_FMT_U8: *type = PeakIndexBuilder::SampleType::U8; return true;
+    case AV_SAMPLE_FMT_S16: *type = PeakIndexBuilder::SampleType::S16; return true;
+    case AV_SAMPLE_FMT_S32: *type = PeakIndexBuilder::SampleType::S32; return true;
+    case AV_SAMPLE_FMT_FLT: *type = PeakIndexBuilder::SampleType::F32; return true;
+    case AV_SAMPLE_FMT_DBL: *type = PeakIndexBuilder::SampleType::F64; return true;
+    default: return false;
+    }
+}
+
+/* Channels in the raw output, planar formats only write the first one */
+static int output_channels(AVSampleFormat sfmt, int channels)
+{
+    return av_sample_fmt_is_planar(sfmt) ? 1 : channels;
+}
 
+static void write_peak_index(PeakIndexBuilder *builder, const std::string &path)
+{
+    builder->finish();
+    if (!builder->write(path.c_str()))
+        return;
+    printf("Peak index: %zu levels, %zu bytes, built in %.2f ms\n",
+           builder->levels(), builder->fileSize(), builder->buildMs());
+}
 
 static int output_audio_frame(AVFrame *frame)
 {
-    size_t unpadded_linesize = frame->nb_samples * av_get_bytes_per_sample((AVSampleFormat)frame->format);
+    size_t unpadded_linesize = frame->nb_samples * output_sample_size(frame);
     printf("audio_frame n:%d nb_samples:%d pts:%s\n",
            audio_frame_count++, frame->nb_samples,
            av_ts_make_time_string(new char[32](), frame->pts, &audio_dec_ctx->time_base));
@@ -62,6 +109,10 @@ static int output_audio_frame(AVFrame *frame)
      * to packed data. */
     fwrite(frame->extended_data[0], 1, unpadded_linesize, audio_dst_file);
 
+    PeakIndexBuilder::SampleType type;
+    if (peak_builder && peak_sample_type((AVSampleFormat)frame->format, &type))
+        peak_builder->add(frame->extended_data[0], type, frame->nb_samples);
+
     return 0;
 }
 
@@ -202,6 +253,7 @@ int AudioDecoder::demuxDecode(const char* src_filepath, const char* audio_dst_fi
 
     src_filename = src_filepath;
     audio_dst_filename = audio_dst_filepath;
+    m_peaks.reset();
 
     /* open input file, and allocate format context */
     if (avformat_open_input(&fmt_ctx, src_filename, NULL, NULL) < 0)
@@ -227,6 +279,12 @@ int AudioDecoder::demuxDecode(const char* src_filepath, const char* audio_dst_fi
             ret = 1;
             goto end;
         }
+        if (!m_peak_path.empty())
+        {
+            m_peaks = std::make_unique<PeakIndexBuilder>(audio_dec_ctx->sample_rate,
+                output_channels(audio_dec_ctx->sample_fmt, audio_dec_ctx->ch_layout.nb_channels));
+            peak_builder = m_peaks.get();
+        }
     }
 
     /* dump input information to stderr */
@@ -302,9 +360,13 @@ int AudioDecoder::demuxDecode(const char* src_filepath, const char* audio_dst_fi
                "ffplay -f %s -ac %d -ar %d %s\n",
                fmt, n_channels, audio_dec_ctx->sample_rate,
                audio_dst_filename);
+
+        if (m_peaks)
+            write_peak_index(m_peaks.get(), m_peak_path);
     }
 
 end:
+    peak_builder = NULL;
     avcodec_free_context(&audio_dec_ctx);
     avformat_close_input(&fmt_ctx);
     if (audio_dst_file)
@@ -315,3 +377,340 @@ end:
     return ret < 0;
 }
 
+
+/* Segment-parallel decoding
+ *
+ * The input is split into N ranges of samples. Every worker opens its own
+ * demuxer and decoder, seeks a little before its range (so that decoders with
+ * inter-frame state are primed again), decodes and keeps only the samples
+ * whose position falls inside [start, end). Positions are derived from the
+ * frame timestamps, so for lossless codecs the stitched output is identical
+ * to the sequential one; lossy ones are decoded sequentially.
+ *
+ * Workers write their samples to a temporary file next to the output instead
+ * of keeping them in memory, so memory use doesn't grow with the length of
+ * the file. The parts are concatenated in order at the end. */
+
+struct AudioSegment
+{
+    int64_t start, end; // sample positions, end == INT64_MAX for the last one
+    std::string part_path; // where the worker writes the segment's samples
+    AVSampleFormat sample_fmt = AV_SAMPLE_FMT_NONE;
+    int sample_rate = 0;
+    int channels = 0;
+    int ret = 0;
+};
+
+// amount of audio decoded and thrown away before each segment
+static constexpr double SEGMENT_PREROLL_SEC = 0.5;
+// bytes copied at a time when the parts are concatenated
+static constexpr size_t SEGMENT_COPY_BYTES = 1 << 20;
+
+static int decode_segment(const char *src_filepath, AudioSegment *seg)
+{
+    AVFormatContext *seg_fmt_ctx = NULL;
+    AVCodecContext *dec_ctx = NULL;
+    AVFrame *seg_frame = NULL;
+    AVPacket *seg_pkt = NULL;
+    AVStream *st;
+    FILE *part_file = NULL;
+    int stream_idx = -1;
+    int64_t next_pos = 0;
+    bool done = false;
+    char err[AV_ERROR_MAX_STRING_SIZE];
+    int ret = 0;
+
+    if ((ret = avformat_open_input(&seg_fmt_ctx, src_filepath, NULL, NULL)) < 0)
+    {
+        fprintf(stderr, "Could not open source file %s\n", src_filepath);
+        return ret;
+    }
+    part_file = fopen(seg->part_path.c_str(), "wb");
+    if (!part_file)
+    {
+        fprintf(stderr, "Could not open temporary file %s\n", seg->part_path.c_str());
+        ret = AVERROR(errno);
+        goto end;
+    }
+    if ((ret = avformat_find_stream_info(seg_fmt_ctx, NULL)) < 0)
+    {
+        fprintf(stderr, "Could not find stream information\n");
+        goto end;
+    }
+    if ((ret = open_codec_context(&stream_idx, &dec_ctx, seg_fmt_ctx, AVMEDIA_TYPE_AUDIO)) < 0)
+        goto end;
+    st = seg_fmt_ctx->streams[stream_idx];
+
+    seg_frame = av_frame_alloc();
+    seg_pkt = av_packet_alloc();
+    if (!seg_frame || !seg_pkt)
+    {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    if (seg->start > 0)
+    {
+        int64_t preroll = (int64_t)(SEGMENT_PREROLL_SEC * dec_ctx->sample_rate);
+        int64_t seek_pos = FFMAX(seg->start - preroll, 0);
+        int64_t ts = av_rescale_q(seek_pos, AVRational{1, dec_ctx->sample_rate}, st->time_base);
+        if (st->start_time != AV_NOPTS_VALUE)
+            ts += st->start_time;
+        if ((ret = av_seek_frame(seg_fmt_ctx, stream_idx, ts, AVSEEK_FLAG_BACKWARD)) < 0)
+        {
+            fprintf(stderr, "Could not seek to sample %" PRId64 " (%s)\n", seek_pos, av_make_error_string(err, sizeof(err), ret));
+            goto end;
+        }
+        next_pos = AV_NOPTS_VALUE;
+    }
+
+    while (!done)
+    {
+        bool eof = av_read_frame(seg_fmt_ctx, seg_pkt) < 0;
+        if (!eof && seg_pkt->stream_index != stream_idx)
+        {
+            av_packet_unref(seg_pkt);
+            continue;
+        }
+
+        // a NULL packet flushes the decoder
+        ret = avcodec_send_packet(dec_ctx, eof ? NULL : seg_pkt);
+        av_packet_unref(seg_pkt);
+        if (ret < 0)
+        {
+            fprintf(stderr, "Error submitting a packet for decoding (%s)\n", av_make_error_string(err, sizeof(err), ret));
+            goto end;
+        }
+
+        while ((ret = avcodec_receive_frame(dec_ctx, seg_frame)) >= 0)
+        {
+            // position of the first sample of this frame in the whole stream
+            int64_t pts = seg_frame->best_effort_timestamp;
+            if (pts != AV_NOPTS_VALUE)
+            {
+                if (st->start_time != AV_NOPTS_VALUE)
+                    pts -= st->start_time;
+                next_pos = av_rescale_q(pts, st->time_base, AVRational{1, seg_frame->sample_rate});
+            }
+            if (next_pos == AV_NOPTS_VALUE)
+            {
+                // can't place the frame after a seek without a timestamp
+                av_frame_unref(seg_frame);
+                continue;
+            }
+
+            int64_t pos = next_pos;
+            next_pos += seg_frame->nb_samples;
+
+            // the first segment keeps the priming samples, like the sequential path
+            int64_t from = seg->start > 0 ? FFMAX(seg->start - pos, 0) : 0;
+            int64_t to = seg_frame->nb_samples;
+            if (seg->end != INT64_MAX)
+                to = FFMIN(seg->end - pos, to);
+            if (from < to)
+            {
+                int sample_size = output_sample_size(seg_frame);
+                const uint8_t *src = seg_frame->extended_data[0];
+                size_t size = (size_t)(to - from) * sample_size;
+                if (fwrite(src + from * sample_size, 1, size, part_file) != size)
+                {
+                    fprintf(stderr, "Could not write temporary file %s\n", seg->part_path.c_str());
+                    ret = AVERROR(EIO);
+                    goto end;
+                }
+            }
+            if (seg->end != INT64_MAX && pos + seg_frame->nb_samples >= seg->end)
+                done = true;
+
+            av_frame_unref(seg_frame);
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        {
+            fprintf(stderr, "Error during decoding (%s)\n", av_make_error_string(err, sizeof(err), ret));
+            goto end;
+        }
+        ret = 0;
+        if (eof)
+            break;
+    }
+
+    seg->sample_fmt = dec_ctx->sample_fmt;
+    seg->sample_rate = dec_ctx->sample_rate;
+    seg->channels = dec_ctx->ch_layout.nb_channels;
+
+end:
+    if (part_file && fclose(part_file) != 0 && ret >= 0)
+        ret = AVERROR(EIO);
+    avcodec_free_context(&dec_ctx);
+    avformat_close_input(&seg_fmt_ctx);
+    av_packet_free(&seg_pkt);
+    av_frame_free(&seg_frame);
+
+    return ret;
+}
+
+static void remove_parts(const std::vector<AudioSegment> &segs)
+{
+    for (const auto &seg : segs)
+        remove(seg.part_path.c_str());
+}
+
+int AudioDecoder::demuxDecodeSegmented(const char* src_filepath, const char* audio_dst_filepath, int segments) {
+    if (segments <= 1)
+        return demuxDecode(src_filepath, audio_dst_filepath);
+
+    AVFormatContext *probe_ctx = NULL;
+    int64_t total_samples = 0;
+    bool lossless = false;
+    int ret = 0;
+
+    /* every segment is a thread with its own demuxer, decoder and part file */
+    int threads = (int)std::thread::hardware_concurrency();
+    if (threads > 0 && segments > threads)
+    {
+        printf("Decoding in %d segments, one per hardware thread, instead of %d\n", threads, segments);
+        segments = threads;
+    }
+    if (segments <= 1)
+        return demuxDecode(src_filepath, audio_dst_filepath);
+
+    /* find out how long the audio stream is, so it can be split up */
+    if (avformat_open_input(&probe_ctx, src_filepath, NULL, NULL) < 0)
+    {
+        fprintf(stderr, "Could not open source file %s\n", src_filepath);
+        return 1;
+    }
+    if (avformat_find_stream_info(probe_ctx, NULL) >= 0)
+    {
+        int idx = av_find_best_stream(probe_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+        if (idx >= 0)
+        {
+            AVStream *st = probe_ctx->streams[idx];
+            const AVCodecDescriptor *desc = avcodec_descriptor_get(st->codecpar->codec_id);
+            lossless = desc && (desc->props & AV_CODEC_PROP_LOSSLESS);
+            int sample_rate = st->codecpar->sample_rate;
+            if (st->duration != AV_NOPTS_VALUE)
+                total_samples = av_rescale_q(st->duration, st->time_base, AVRational{1, sample_rate});
+            else if (probe_ctx->duration != AV_NOPTS_VALUE)
+                total_samples = av_rescale(probe_ctx->duration, sample_rate, AV_TIME_BASE);
+        }
+    }
+    avformat_close_input(&probe_ctx);
+
+    if (total_samples <= 0)
+    {
+        printf("Duration of the audio stream unknown, decoding sequentially\n");
+        return demuxDecode(src_filepath, audio_dst_filepath);
+    }
+    /* Lossy decoders can carry state further than the preroll reaches, e.g.
+     * the noise generator of AAC's perceptual noise substitution, so a segment
+     * decoded after a seek is close to but not the same as the sequential
+     * output. Only lossless codecs (PCM, FLAC, ALAC, ...) are split up. */
+    if (!lossless)
+    {
+        printf("Lossy codec, decoding sequentially to keep the output sample exact\n");
+        return demuxDecode(src_filepath, audio_dst_filepath);
+    }
+
+    std::vector<AudioSegment> segs(segments);
+    for (int i = 0; i < segments; i++)
+    {
+        segs[i].start = total_samples * i / segments;
+        segs[i].end = (i == segments - 1) ? INT64_MAX : total_samples * (i + 1) / segments;
+        segs[i].part_path = std::string(audio_dst_filepath) + ".part" + std::to_string(i);
+    }
+
+    printf("Decoding audio from file '%s' in %d segments\n", src_filepath, segments);
+    std::vector<std::thread> workers;
+    workers.reserve(segments);
+    for (auto &seg : segs)
+        workers.emplace_back([src_filepath, &seg]() { seg.ret = decode_segment(src_filepath, &seg); });
+    for (auto &worker : workers)
+        worker.join();
+
+    for (const auto &seg : segs)
+    {
+        if (seg.ret < 0)
+        {
+            remove_parts(segs);
+            return 1;
+        }
+    }
+
+    enum AVSampleFormat sfmt = segs[0].sample_fmt;
+    int n_channels = segs[0].channels;
+    const char *fmt;
+    if (av_sample_fmt_is_planar(sfmt))
+    {
+        sfmt = av_get_packed_sample_fmt(sfmt);
+        n_channels = 1;
+    }
+    if ((ret = get_format_from_sample_fmt(&fmt, sfmt)) < 0)
+    {
+        remove_parts(segs);
+        return 1;
+    }
+
+    this->m_format = fmt;
+    this->m_sample_rate = segs[0].sample_rate;
+    this->m_channels = n_channels;
+
+    /* the peak blocks straddle segment boundaries, so the index is built
+     * from the stitched samples as they are written */
+    m_peaks.reset();
+    PeakIndexBuilder::SampleType type;
+    if (!m_peak_path.empty() && peak_sample_type(sfmt, &type))
+        m_peaks = std::make_unique<PeakIndexBuilder>(m_sample_rate, n_channels);
+
+    /* stitch the segments together */
+    FILE *dst_file = fopen(audio_dst_filepath, "wb");
+    if (!dst_file)
+    {
+        fprintf(stderr, "Could not open destination file %s\n", audio_dst_filepath);
+        remove_parts(segs);
+        return 1;
+    }
+    const size_t frame_size = (size_t)av_get_bytes_per_sample(sfmt) * n_channels;
+    // whole sample frames per copy, the parts only hold whole frames
+    std::vector<uint8_t> buf(SEGMENT_COPY_BYTES - SEGMENT_COPY_BYTES % frame_size);
+    bool ok = true;
+    for (const auto &seg : segs)
+    {
+        FILE *part_file = fopen(seg.part_path.c_str(), "rb");
+        if (!part_file)
+        {
+            fprintf(stderr, "Could not open temporary file %s\n", seg.part_path.c_str());
+            ok = false;
+            break;
+        }
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), part_file)) > 0)
+        {
+            if (fwrite(buf.data(), 1, n, dst_file) != n)
+            {
+                fprintf(stderr, "Could not write destination file %s\n", audio_dst_filepath);
+                ok = false;
+                break;
+            }
+            if (m_peaks)
+                m_peaks->add(buf.data(), type, n / frame_size);
+        }
+        fclose(part_file);
+        // free the disk space as soon as the part is copied
+        remove(seg.part_path.c_str());
+        if (!ok)
+            break;
+    }
+    if (fclose(dst_file) != 0)
+        ok = false;
+    if (!ok)
+    {
+        remove_parts(segs);
+        m_peaks.reset();
+        return 1;
+    }
+    if (m_peaks)
+        write_peak_index(m_peaks.get(), m_peak_path);
+
+    return 0;
+}
@@ -9,6 +9,9 @@ extern "C"
 #include <libavformat/avformat.h>
 }
 
+#include "peak_index.hpp"
+
+#include <memory>
 #include <string>
 
 class AudioDecoder
@@ -17,8 +20,24 @@ private:
     std::string m_format;
     int m_sample_rate;
     int m_channels;
+    std::string m_peak_path;
+    std::unique_ptr<PeakIndexBuilder> m_peaks;
 public:
     int demuxDecode(const char* src_filepath, const char* audio_dst_filepath);
+    // Splits the audio into `segments` time ranges (at most one per hardware
+    // thread) which are decoded in parallel and stitched together. Only done
+    // for lossless codecs, where the output is bit-identical to demuxDecode;
+    // anything else is decoded sequentially.
+    int demuxDecodeSegmented(const char* src_filepath, const char* audio_dst_filepath, int segments);
+    // Builds a waveform peak index while decoding and writes it to `path`,
+    // see PeakIndex. An empty path turns it off again.
+    void setPeakIndexPath(const std::string& path) {
+        m_peak_path = path;
+    }
+    // index built by the last decode, nullptr if none was requested
+    const PeakIndexBuilder* getPeakIndex() const {
+        return m_peaks.get();
+    }
     const std::string& getFormat() const {
         return m_format;
     }
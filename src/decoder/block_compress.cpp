@@ -0,0 +1,417 @@
+#include "block_compress.hpp"
+#include "simd.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace bcn {
+
+namespace {
+
+// BC7 interpolation weights for 4 bit indices
+constexpr int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Block
+{
+    uint8_t px[16][4];
+};
+
+// SIMD kernels for the per-pixel loops, picked once
+struct Kernels
+{
+    simd::MomentsFn moments = simd::moments_kernel();
+    simd::ProjectFn project = simd::project_kernel();
+};
+
+const Kernels& kernels()
+{
+    static const Kernels k;
+    return k;
+}
+
+// Reads a 4x4 block, repeating the last row/column past the image edge.
+void load_block(const uint8_t* rgba, int stride, int width, int height, int bx, int by, Block& block)
+{
+    if (bx * 4 + 4 <= width && by * 4 + 4 <= height)
+    {
+        for (int y = 0; y < 4; y++)
+            memcpy(block.px[y * 4], rgba + (size_t)(by * 4 + y) * stride + (size_t)bx * 16, 16);
+        return;
+    }
+    for (int y = 0; y < 4; y++)
+    {
+        const uint8_t* row = rgba + (size_t)std::min(by * 4 + y, height - 1) * stride;
+        for (int x = 0; x < 4; x++)
+            memcpy(block.px[y * 4 + x], row + (size_t)std::min(bx * 4 + x, width - 1) * 4, 4);
+    }
+}
+
+// Extremes of the block's colours along their principal axis.
+void principal_endpoints(const Block& block, float lo[3], float hi[3])
+{
+    // integer sums are exact: 16 * 255 * 255 fits easily
+    int sum[3];
+    int products[6]; // rr rg rb gg gb bb
+    kernels().moments(block.px[0], sum, products);
+    const float mean[3] = {sum[0] / 16.0f, sum[1] / 16.0f, sum[2] / 16.0f};
+    const float cov[6] = {
+        products[0] - sum[0] * mean[0], products[1] - sum[0] * mean[1], products[2] - sum[0] * mean[2],
+        products[3] - sum[1] * mean[1], products[4] - sum[1] * mean[2], products[5] - sum[2] * mean[2],
+    };
+
+    // a few power iterations are plenty for a 3x3 matrix
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int i = 0; i < 4; i++)
+    {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float len = std::max({std::fabs(x), std::fabs(y), std::fabs(z)});
+        if (len < 1e-3f)
+            break; // flat block, any axis will do
+        const float inv = 1.0f / len;
+        axis[0] = x * inv;
+        axis[1] = y * inv;
+        axis[2] = z * inv;
+    }
+    const float norm = 1.0f / std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (float& a : axis)
+        a *= norm;
+
+    float t[16];
+    kernels().project(block.px[0], mean, axis, 1.0f, t);
+    float tmin = 0.0f, tmax = 0.0f;
+    for (float v : t)
+    {
+        tmin = std::min(tmin, v);
+        tmax = std::max(tmax, v);
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        lo[c] = std::clamp(mean[c] + tmin * axis[c], 0.0f, 255.0f);
+        hi[c] = std::clamp(mean[c] + tmax * axis[c], 0.0f, 255.0f);
+    }
+}
+
+int round_to_int(float v)
+{
+    return (int)(v + 0.5f); // v >= 0
+}
+
+// Position of every pixel along from -> to, 0 at `from` and `steps` at `to`,
+// rounded and clamped. Picking indices this way costs a dot product per
+// pixel instead of a search through the palette.
+void project(const Block& block, const int from[3], const int to[3], int steps, int out[16])
+{
+    const float origin[3] = {(float)from[0], (float)from[1], (float)from[2]};
+    const float d[3] = {(float)(to[0] - from[0]), (float)(to[1] - from[1]), (float)(to[2] - from[2])};
+    const float len2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    const float scale = len2 > 0.0f ? steps / len2 : 0.0f;
+    float t[16];
+    kernels().project(block.px[0], origin, d, scale, t);
+    for (int i = 0; i < 16; i++)
+        out[i] = std::clamp((int)(t[i] + 0.5f), 0, steps);
+}
+
+// --- BC1 ---
+
+uint16_t pack565(const float c[3])
+{
+    const int r = round_to_int(c[0] * 31.0f / 255.0f);
+    const int g = round_to_int(c[1] * 63.0f / 255.0f);
+    const int b = round_to_int(c[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t v, int out[3])
+{
+    const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+void bc1_palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+void encode_bc1(const Block& block, uint8_t* out)
+{
+    float lo[3], hi[3];
+    principal_endpoints(block, lo, hi);
+    uint16_t c0 = pack565(hi), c1 = pack565(lo);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        // palette order along the line is c0, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1, c1
+        static constexpr uint32_t ORDER[4] = {0, 2, 3, 1};
+        int palette[4][3];
+        bc1_palette(c0, c1, palette);
+        int steps[16];
+        project(block, palette[0], palette[1], 3, steps);
+        for (int i = 0; i < 16; i++)
+            indices |= ORDER[steps[i]] << (2 * i);
+    }
+    // c0 == c1 only ever gives 3 colour mode, where index 0 is still c0
+
+    const uint8_t bytes[8] = {(uint8_t)c0, (uint8_t)(c0 >> 8), (uint8_t)c1, (uint8_t)(c1 >> 8),
+                              (uint8_t)indices, (uint8_t)(indices >> 8), (uint8_t)(indices >> 16),
+                              (uint8_t)(indices >> 24)};
+    memcpy(out, bytes, 8);
+}
+
+void decode_bc1(const uint8_t* in, uint8_t px[16][4])
+{
+    const uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+    const uint32_t indices = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+    int palette[4][3];
+    bc1_palette(c0, c1, palette);
+    for (int i = 0; i < 16; i++)
+    {
+        const int* c = palette[(indices >> (2 * i)) & 3];
+        px[i][0] = (uint8_t)c[0];
+        px[i][1] = (uint8_t)c[1];
+        px[i][2] = (uint8_t)c[2];
+        px[i][3] = 255;
+    }
+}
+
+// --- BC7 mode 6 ---
+
+struct Bits
+{
+    uint64_t word[2] = {0, 0};
+    int pos = 0;
+
+    // count <= 32
+    void put(uint32_t value, int count)
+    {
+        const int shift = pos & 63;
+        word[pos >> 6] |= (uint64_t)value << shift;
+        if (shift + count > 64)
+            word[1] |= (uint64_t)value >> (64 - shift);
+        pos += count;
+    }
+    uint32_t get(int count)
+    {
+        const int shift = pos & 63;
+        uint64_t value = word[pos >> 6] >> shift;
+        if (shift + count > 64)
+            value |= word[1] << (64 - shift);
+        pos += count;
+        return (uint32_t)(value & ((1ull << count) - 1));
+    }
+};
+
+// 7 bit RGBA endpoint plus the p-bit that completes all four channels
+struct Endpoint
+{
+    int q[4];
+    int p;
+};
+
+Endpoint quantize_bc7(const float rgb[3])
+{
+    const float v[4] = {rgb[0], rgb[1], rgb[2], 255.0f};
+    Endpoint best{};
+    float best_err = INFINITY;
+    for (int p = 0; p < 2; p++)
+    {
+        Endpoint e{};
+        e.p = p;
+        float err = 0.0f;
+        for (int c = 0; c < 4; c++)
+        {
+            e.q[c] = std::clamp(round_to_int(std::max(v[c] - p, 0.0f) * 0.5f), 0, 127);
+            const float d = (float)((e.q[c] << 1) | p) - v[c];
+            err += d * d;
+        }
+        if (err < best_err)
+        {
+            best_err = err;
+            best = e;
+        }
+    }
+    return best;
+}
+
+void bc7_palette(const Endpoint& e0, const Endpoint& e1, int palette[16][4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        const int a = (e0.q[c] << 1) | e0.p, b = (e1.q[c] << 1) | e1.p;
+        for (int i = 0; i < 16; i++)
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * a + BC7_WEIGHTS[i] * b + 32) >> 6;
+    }
+}
+
+void write_bc7(const Endpoint& e0, const Endpoint& e1, const uint8_t indices[16], uint8_t* out)
+{
+    Bits bits;
+    bits.put(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        bits.put((uint32_t)e0.q[c], 7);
+        bits.put((uint32_t)e1.q[c], 7);
+    }
+    bits.put((uint32_t)e0.p, 1);
+    bits.put((uint32_t)e1.p, 1);
+    bits.put(indices[0], 3); // the anchor's top bit is implied 0
+    for (int i = 1; i < 16; i++)
+        bits.put(indices[i], 4);
+    for (int i = 0; i < 16; i++)
+        out[i] = (uint8_t)(bits.word[i >> 3] >> ((i & 7) * 8));
+}
+
+void encode_bc7(const Block& block, uint8_t* out)
+{
+    float lo[3], hi[3];
+    principal_endpoints(block, lo, hi);
+    Endpoint e0 = quantize_bc7(lo), e1 = quantize_bc7(hi);
+
+    // the weight nearest to every 64th along the line
+    static const auto NEAREST = [] {
+        std::array<uint8_t, 65> nearest{};
+        for (int t = 0; t <= 64; t++)
+            for (int i = 1; i < 16; i++)
+                if (std::abs(BC7_WEIGHTS[i] - t) < std::abs(BC7_WEIGHTS[nearest[t]] - t))
+                    nearest[t] = (uint8_t)i;
+        return nearest;
+    }();
+    int from[3], to[3];
+    for (int c = 0; c < 3; c++)
+    {
+        from[c] = (e0.q[c] << 1) | e0.p;
+        to[c] = (e1.q[c] << 1) | e1.p;
+    }
+    int steps[16];
+    project(block, from, to, 64, steps);
+    uint8_t indices[16];
+    for (int i = 0; i < 16; i++)
+        indices[i] = NEAREST[steps[i]];
+
+    if (indices[0] & 8)
+    {
+        // the first index must fit 3 bits: swap the endpoints, mirror the weights
+        std::swap(e0, e1);
+        for (uint8_t& index : indices)
+            index = (uint8_t)(15 - index);
+    }
+    write_bc7(e0, e1, indices, out);
+}
+
+void decode_bc7(const uint8_t* in, uint8_t px[16][4])
+{
+    Bits bits;
+    for (int i = 0; i < 16; i++)
+        bits.word[i >> 3] |= (uint64_t)in[i] << ((i & 7) * 8);
+    if (bits.get(7) != 1u << 6)
+    {
+        memset(px, 0, 16 * 4);
+        return;
+    }
+    Endpoint e0{}, e1{};
+    for (int c = 0; c < 4; c++)
+    {
+        e0.q[c] = (int)bits.get(7);
+        e1.q[c] = (int)bits.get(7);
+    }
+    e0.p = (int)bits.get(1);
+    e1.p = (int)bits.get(1);
+    int palette[16][4];
+    bc7_palette(e0, e1, palette);
+    for (int i = 0; i < 16; i++)
+    {
+        const int* c = palette[bits.get(i == 0 ? 3 : 4)];
+        for (int k = 0; k < 4; k++)
+            px[i][k] = (uint8_t)c[k];
+    }
+}
+
+} // namespace
+
+const char* kernelName()
+{
+    return simd::block_kernel_name();
+}
+
+const char* formatName(Format format)
+{
+    return format == Format::BC1 ? "BC1" : "BC7";
+}
+
+size_t blockBytes(Format format)
+{
+    return format == Format::BC1 ? 8 : 16;
+}
+
+size_t compressedSize(Format format, int width, int height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+void compress(Format format, const uint8_t* rgba, int stride, int width, int height, uint8_t* out, WorkerPool* pool)
+{
+    const int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    const size_t row_bytes = (size_t)blocks_x * blockBytes(format);
+    auto encode_row = [&](size_t by) {
+        uint8_t* dst = out + by * row_bytes;
+        Block block;
+        for (int bx = 0; bx < blocks_x; bx++)
+        {
+            load_block(rgba, stride, width, height, bx, (int)by, block);
+            if (format == Format::BC1)
+                encode_bc1(block, dst + (size_t)bx * 8);
+            else
+                encode_bc7(block, dst + (size_t)bx * 16);
+        }
+    };
+    if (pool)
+        pool->parallelFor((size_t)blocks_y, encode_row);
+    else
+        for (int by = 0; by < blocks_y; by++)
+            encode_row((size_t)by);
+}
+
+void decompress(Format format, const uint8_t* blocks, int width, int height, uint8_t* rgba, int stride)
+{
+    const int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    uint8_t px[16][4];
+    for (int by = 0; by < blocks_y; by++)
+    {
+        for (int bx = 0; bx < blocks_x; bx++)
+        {
+            if (format == Format::BC1)
+                decode_bc1(blocks, px);
+            else
+                decode_bc7(blocks, px);
+            blocks += blockBytes(format);
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(rgba + (size_t)(by * 4 + y) * stride + (size_t)(bx * 4 + x) * 4, px[y * 4 + x], 4);
+        }
+    }
+}
+
+} // namespace bcn
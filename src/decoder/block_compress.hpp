@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class WorkerPool;
+
+// CPU encoders for the GPU block compressed formats, to keep cached frames
+// 4x (BC7) or 8x (BC1) smaller than RGBA in memory and on upload.
+//
+// Both encode a 4x4 block at a time from 4 bytes per pixel RGBA/RGB0 input
+// and treat it as opaque. Endpoints come from the principal axis of the
+// block's colours, indices from projecting every pixel onto that axis:
+// - BC1: 565 endpoints, 4 colours, 8 bytes per block
+// - BC7: mode 6 only, 7 bit + p-bit RGBA endpoints, 16 weights, 16 bytes
+// That is a fast, single-pass encoder, not an exhaustive one; it trades a
+// dB or two of PSNR for being cheap enough to run on every cached frame.
+namespace bcn {
+
+enum class Format
+{
+    BC1,
+    BC7,
+};
+
+const char* formatName(Format format);
+// SIMD kernel set the encoders use ("avx2", "sse2", "neon" or "scalar")
+const char* kernelName();
+// bytes of one 4x4 block
+size_t blockBytes(Format format);
+// bytes of a width x height image, partial blocks at the edges included
+size_t compressedSize(Format format, int width, int height);
+
+// Encodes `rgba` (stride in bytes) into blocks in row order. With a pool, rows
+// of blocks are spread over it and the calling thread.
+void compress(Format format, const uint8_t* rgba, int stride, int width, int height, uint8_t* out,
+              WorkerPool* pool = nullptr);
+
+// Decodes back to RGBA, for measuring quality. BC7 blocks in other modes
+// than 6 decode to black.
+void decompress(Format format, const uint8_t* blocks, int width, int height, uint8_t* rgba, int stride);
+
+} // namespace bcn
@@ -0,0 +1,191 @@
+#include "clip_store.hpp"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+ClipStore::~ClipStore()
+{
+    clear();
+}
+
+void ClipStore::clear()
+{
+    for (Frame& frame : m_frames)
+        av_free(frame.data);
+    m_frames.clear();
+    m_duration = 0.0;
+}
+
+// PSNR of the RGB channels of a block compressed frame against its source
+double ClipStore::measure_psnr(bcn::Format format, const std::vector<uint8_t>& rgba, const uint8_t* blocks) const
+{
+    std::vector<uint8_t> decoded(rgba.size());
+    bcn::decompress(format, blocks, m_width, m_height, decoded.data(), m_width * 4);
+    double sum = 0.0;
+    for (size_t i = 0; i < rgba.size(); i += 4)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const double d = (double)rgba[i + c] - decoded[i + c];
+            sum += d * d;
+        }
+    }
+    const double mse = sum / (rgba.size() / 4 * 3);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+static bcn::Format block_format(ClipStore::Format format)
+{
+    return format == ClipStore::Format::BC1 ? bcn::Format::BC1 : bcn::Format::BC7;
+}
+
+bool ClipStore::load(VideoReader& reader, Format format, size_t max_bytes, WorkerPool* pool)
+{
+    clear();
+    auto start = std::chrono::steady_clock::now();
+    const auto& state = reader.videoReaderState;
+
+    m_format = format;
+    m_width = state.width;
+    m_height = state.height;
+    m_compress_ms = 0.0;
+    m_psnr = 0.0;
+    std::vector<uint8_t> rgba; // frames on their way to block compression
+    if (compressed())
+    {
+        if (state.output_pix_fmt != AV_PIX_FMT_RGB0 && state.output_pix_fmt != AV_PIX_FMT_RGBA)
+        {
+            printf("Block compression needs RGB0 frames, not %s\n", av_get_pix_fmt_name(state.output_pix_fmt));
+            return false;
+        }
+        rgba.resize((size_t)m_width * m_height * 4);
+    }
+    // for frames without any timestamp: their position at the stream's rate
+    AVRational rate = av_guess_frame_rate(state.av_format_ctx, state.av_format_ctx->streams[state.video_stream_index], nullptr);
+    const double frame_interval = rate.num > 0 && rate.den > 0 ? 1.0 / av_q2d(rate) : 1.0 / 30.0;
+    // video_reader_decode_frame stops at the last packet; the frames the decoder
+    // still holds back for reordering come out after the NULL flush packet
+    bool draining = false;
+    auto next_frame = [&]()
+    {
+        if (!draining && reader.video_reader_decode_frame())
+            return true;
+        if (!draining)
+        {
+            draining = true;
+            if (avcodec_send_packet(state.av_codec_ctx, nullptr) < 0)
+                return false;
+        }
+        return avcodec_receive_frame(state.av_codec_ctx, state.av_frame) == 0;
+    };
+    double origin = 0.0, last = 0.0, interval = 0.0;
+    while (next_frame())
+    {
+        const AVFrame* decoded = state.av_frame;
+        if (m_frames.empty() && compressed())
+        {
+            m_pix_fmt = state.output_pix_fmt;
+            m_frame_bytes = bcn::compressedSize(block_format(format), m_width, m_height);
+        }
+        else if (m_frames.empty())
+        {
+            m_pix_fmt = format == Format::Native ? (AVPixelFormat)decoded->format : state.output_pix_fmt;
+            const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(m_pix_fmt);
+            const int size = av_image_get_buffer_size(m_pix_fmt, m_width, m_height, ALIGN);
+            if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) ||
+                size < 0)
+            {
+                printf("Can't keep %s frames in memory\n", av_get_pix_fmt_name(m_pix_fmt));
+                return false;
+            }
+            m_frame_bytes = (size_t)size;
+        }
+        if (format == Format::Native && (decoded->format != m_pix_fmt || decoded->width != m_width ||
+                                         decoded->height != m_height))
+        {
+            printf("Clip changes format midway, not keeping it in memory\n");
+            clear();
+            return false;
+        }
+        if (bytes() + m_frame_bytes > max_bytes)
+        {
+            printf("Clip takes more than %zu MiB, not keeping it in memory\n", max_bytes >> 20);
+            clear();
+            return false;
+        }
+
+        Frame frame;
+        frame.data = static_cast<uint8_t*>(av_malloc(m_frame_bytes));
+        if (!frame.data)
+        {
+            printf("Couldn't allocate clip frame\n");
+            clear();
+            return false;
+        }
+        double time = decoded->best_effort_timestamp != AV_NOPTS_VALUE
+                          ? decoded->best_effort_timestamp * av_q2d(state.time_base)
+                          : origin + m_frames.size() * frame_interval;
+        if (m_frames.empty())
+            origin = time;
+        frame.time = time - origin;
+        if (!m_frames.empty() && frame.time > last)
+            interval = frame.time - last;
+        last = frame.time;
+        m_frames.push_back(frame);
+
+        if (compressed())
+        {
+            uint8_t* dest[4] = { rgba.data(), nullptr, nullptr, nullptr };
+            int dest_linesize[4] = { m_width * 4, 0, 0, 0 };
+            reader.video_reader_convert_frame(dest, dest_linesize);
+            auto compress_start = std::chrono::steady_clock::now();
+            bcn::compress(block_format(format), rgba.data(), m_width * 4, m_width, m_height, frame.data, pool);
+            m_compress_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compress_start).count();
+            if (m_frames.size() == 1)
+                m_psnr = measure_psnr(block_format(format), rgba, frame.data);
+            continue;
+        }
+
+        AVFrame stored{};
+        this->frame(m_frames.size() - 1, &stored);
+        if (format == Format::Native)
+            av_image_copy(stored.data, stored.linesize, const_cast<const uint8_t**>(decoded->data), decoded->linesize,
+                          m_pix_fmt, m_width, m_height);
+        else
+            reader.video_reader_convert_frame(stored.data, stored.linesize);
+    }
+    if (m_frames.empty())
+        return false;
+
+    // decoders may hand out frames slightly out of order around reordering
+    std::stable_sort(m_frames.begin(), m_frames.end(), [](const Frame& a, const Frame& b) { return a.time < b.time; });
+    m_duration = m_frames.back().time + (interval > 0.0 ? interval : 1.0 / 30.0);
+    m_load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+const char* ClipStore::formatName() const
+{
+    return compressed() ? bcn::formatName(block_format(m_format)) : av_get_pix_fmt_name(m_pix_fmt);
+}
+
+size_t ClipStore::frameAt(double time) const
+{
+    auto it = std::upper_bound(m_frames.begin(), m_frames.end(), time,
+                               [](double t, const Frame& frame) { return t < frame.time; });
+    return it == m_frames.begin() ? 0 : (size_t)(it - m_frames.begin()) - 1;
+}
+
+void ClipStore::frame(size_t i, AVFrame* out) const
+{
+    av_image_fill_arrays(out->data, out->linesize, m_frames[i].data, m_pix_fmt, m_width, m_height, ALIGN);
+    out->format = m_pix_fmt;
+    out->width = m_width;
+    out->height = m_height;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "block_compress.hpp"
+#include "video_reader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A short clip decoded once into memory, for playing it over and over without
+// demuxing or decoding it again.
+//
+// Frames are kept either as the decoder produced them (planar YUV is a half
+// or less of RGB0 for 4:2:0) and converted when shown, already converted to
+// the reader's output format so showing one is a plain copy, or converted and
+// block compressed for a compressed texture (BC1 is an eighth, BC7 a quarter
+// of RGB0). Each frame is one aligned block, frame() hands out an AVFrame
+// pointing into it, data() the blocks of a compressed one.
+class ClipStore
+{
+public:
+    enum class Format
+    {
+        Native, // decoder output, converted on every presentation
+        Output, // the reader's output_pix_fmt, copied on presentation
+        BC1,    // RGB0 output encoded to BC1, uploaded compressed
+        BC7,    // same with BC7
+    };
+
+    ClipStore() = default;
+    ~ClipStore();
+    ClipStore(const ClipStore&) = delete;
+    ClipStore& operator=(const ClipStore&) = delete;
+
+    // Decodes the rest of `reader` into memory. Returns false, keeping
+    // nothing, if it takes more than max_bytes or the format can't be stored.
+    // Block compression runs on `pool` if there is one; the reader has to
+    // deliver RGB0 or RGBA for it.
+    bool load(VideoReader& reader, Format format, size_t max_bytes, WorkerPool* pool = nullptr);
+    void clear();
+
+    size_t frames() const { return m_frames.size(); }
+    // seconds from the first frame
+    double frameTime(size_t i) const { return m_frames[i].time; }
+    // until the first frame is due again
+    double duration() const { return m_duration; }
+    // the frame on screen at `time`, 0 <= time < duration()
+    size_t frameAt(double time) const;
+    // Points `out` at frame i; the data is not reference counted and stays
+    // valid as long as the store.
+    void frame(size_t i, AVFrame* out) const;
+    const uint8_t* data(size_t i) const { return m_frames[i].data; }
+    bool compressed() const { return m_format == Format::BC1 || m_format == Format::BC7; }
+
+    Format format() const { return m_format; }
+    AVPixelFormat pixFmt() const { return m_pix_fmt; }
+    // the pixel format, or the block format of a compressed clip
+    const char* formatName() const;
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    size_t bytes() const { return m_frame_bytes * m_frames.size(); }
+    size_t frameBytes() const { return m_frame_bytes; }
+    double loadMs() const { return m_load_ms; }
+    // time spent block compressing, part of loadMs()
+    double compressMs() const { return m_compress_ms; }
+    // of the first frame after block compression
+    double psnr() const { return m_psnr; }
+
+private:
+    // rows of every plane are aligned for the SIMD paths of swscale
+    static constexpr int ALIGN = 64;
+
+    struct Frame
+    {
+        uint8_t* data;
+        double time;
+    };
+
+    double measure_psnr(bcn::Format format, const std::vector<uint8_t>& rgba, const uint8_t* blocks) const;
+
+    std::vector<Frame> m_frames;
+    Format m_format = Format::Native;
+    AVPixelFormat m_pix_fmt = AV_PIX_FMT_NONE;
+    int m_width = 0, m_height = 0;
+    size_t m_frame_bytes = 0;
+    double m_duration = 0.0;
+    double m_load_ms = 0.0;
+    double m_compress_ms = 0.0;
+    double m_psnr = 0.0;
+};
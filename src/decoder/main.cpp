@@ -1,20 +1,77 @@
 #include "audio_demux_decode.hpp"
 #include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
 #include <stdlib.h>
 
-int main(int argc, char **argv)
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-j segments] [--verify] [--peaks peak_file] input_file audio_output_file\n"
+                    "API example program to show how to read frames from an input file.\n"
+                    "This program reads frames from a file, decodes them, and writes decoded\n"
+                    "audio frames to a rawaudio file named audio_output_file.\n"
+                    "With -j the audio of lossless codecs is split into that many segments\n"
+                    "(at most one per hardware thread) which are decoded in parallel.\n"
+                    "--verify additionally decodes sequentially and checks that both\n"
+                    "outputs are bit-identical. --peaks writes a waveform peak index of\n"
+                    "the audio to peak_file.\n",
+            prog);
+    exit(1);
+}
+
+static std::string read_file(const std::string &path)
 {
-    int ret = 0;
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
 
-    if (argc != 3)
+int main(int argc, char **argv)
+{
+    int segments = 1;
+    bool verify = false;
+    const char *peaks = NULL;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++)
     {
-        fprintf(stderr, "usage: %s  input_file audio_output_file\n"
-                        "API example program to show how to read frames from an input file.\n"
-                        "This program reads frames from a file, decodes them, and writes decoded\n"
-                        "audio frames to a rawaudio file named audio_output_file.\n",
-                argv[0]);
-        exit(1);
+        if (!strcmp(argv[argi], "-j") && argi + 1 < argc)
+        {
+            char *end;
+            long value = strtol(argv[++argi], &end, 10);
+            if (*end != '\0' || value < 1 || value > 1024)
+                usage(argv[0]);
+            segments = (int)value;
+        }
+        else if (!strcmp(argv[argi], "--verify"))
+            verify = true;
+        else if (!strcmp(argv[argi], "--peaks") && argi + 1 < argc)
+            peaks = argv[++argi];
+        else
+            usage(argv[0]);
     }
+    if (argc - argi != 2 || segments < 1)
+        usage(argv[0]);
+
+    const char *src = argv[argi];
+    const char *dst = argv[argi + 1];
     auto adec = new AudioDecoder();
-    return adec->demuxDecode(argv[1], argv[2]);
-}
\ No newline at end of file
+    if (peaks)
+        adec->setPeakIndexPath(peaks);
+    int ret = adec->demuxDecodeSegmented(src, dst, segments);
+    if (ret || !verify)
+        return ret;
+
+    std::string seq_dst = std::string(dst) + ".seq";
+    auto seq_dec = new AudioDecoder();
+    if ((ret = seq_dec->demuxDecode(src, seq_dst.c_str())))
+        return ret;
+
+    if (read_file(dst) != read_file(seq_dst))
+    {
+        fprintf(stderr, "Segmented output differs from sequential output '%s'\n", seq_dst.c_str());
+        return 1;
+    }
+    printf("Segmented output is bit-identical to the sequential output\n");
+    return 0;
+}
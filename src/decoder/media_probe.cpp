@@ -0,0 +1,71 @@
+#include "media_probe.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/dict.h>
+}
+
+// bytes and microseconds avformat may read to guess what isn't in the header
+static const char* const PROBE_SIZE = "262144";
+static const char* const ANALYZE_DURATION = "500000";
+
+static bool streamKnown(const AVStream* stream)
+{
+    const AVCodecParameters* par = stream->codecpar;
+    if (par->codec_id == AV_CODEC_ID_NONE)
+        return false;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        return par->width > 0 && par->height > 0 && (stream->avg_frame_rate.num > 0 || stream->r_frame_rate.num > 0);
+    return true;
+}
+
+bool probeMedia(const char* filename, MediaProbe& out)
+{
+    AVFormatContext* fmt_ctx = nullptr;
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "probesize", PROBE_SIZE, 0);
+    av_dict_set(&options, "analyzeduration", ANALYZE_DURATION, 0);
+    int ret = avformat_open_input(&fmt_ctx, filename, nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+        return false;
+
+    // most containers (mp4, mkv, mov) have everything in the header; reading
+    // packets is only worth it for the ones that don't, e.g. MPEG-TS
+    int stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0)
+        stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (stream_index < 0 || !streamKnown(fmt_ctx->streams[stream_index]) || fmt_ctx->duration == AV_NOPTS_VALUE)
+    {
+        if (avformat_find_stream_info(fmt_ctx, nullptr) >= 0)
+        {
+            stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            if (stream_index < 0)
+                stream_index = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        }
+    }
+
+    out = MediaProbe();
+    if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0)
+        out.duration = fmt_ctx->duration / (double)AV_TIME_BASE;
+    if (stream_index >= 0)
+    {
+        const AVStream* stream = fmt_ctx->streams[stream_index];
+        const AVCodecParameters* par = stream->codecpar;
+        if (out.duration == 0.0 && stream->duration != AV_NOPTS_VALUE && stream->duration > 0)
+            out.duration = stream->duration * av_q2d(stream->time_base);
+        out.codec = avcodec_get_name(par->codec_id);
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            out.width = par->width;
+            out.height = par->height;
+            AVRational rate = stream->avg_frame_rate.num > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+            if (rate.num > 0 && rate.den > 0)
+                out.frameRate = av_q2d(rate);
+        }
+    }
+
+    avformat_close_input(&fmt_ctx);
+    return stream_index >= 0;
+}
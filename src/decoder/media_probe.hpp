@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+// What a file browser shows about a clip without decoding it.
+struct MediaProbe
+{
+    double duration = 0.0;  // seconds, 0 if unknown
+    int width = 0;          // of the first video stream, 0 if there is none
+    int height = 0;
+    double frameRate = 0.0; // 0 if unknown
+    std::string codec;      // short ffmpeg name, e.g. "h264"
+};
+
+// Reads the container header of `filename`, looking at no more than a few
+// hundred KiB or half a second of packets when the header alone doesn't tell
+// the stream parameters. Audio only files report a duration and codec only.
+// False if ffmpeg can't open the file or it has no audio or video. Thread safe.
+bool probeMedia(const char* filename, MediaProbe& out);
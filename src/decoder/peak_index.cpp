@@ -0,0 +1,380 @@
+#include "peak_index.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Sidecar layout, native byte order:
+ *
+ *   PeakFileHeader
+ *   levels x { uint64 offset, uint64 count }
+ *   Peak arrays, level 0 first, each starting at its offset
+ */
+static const char PEAK_MAGIC[8] = {'P', 'E', 'A', 'K', 'I', 'D', 'X', '1'};
+static constexpr uint32_t PEAK_VERSION = 1;
+
+struct PeakFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t base_block;
+    uint64_t frames;
+    uint32_t levels;
+    uint32_t reserved;
+};
+static_assert(sizeof(PeakFileHeader) == 40, "sidecar header must not contain padding");
+static_assert(sizeof(Peak) == 6, "sidecar peaks must not contain padding");
+
+static constexpr size_t CONVERT_FRAMES = 4096;
+
+static int16_t quantize(float v)
+{
+    return (int16_t)std::clamp(std::lround(v * 32767.0f), -32767L, 32767L);
+}
+
+static int64_t elapsed_ns(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+PeakIndexBuilder::PeakIndexBuilder(int sample_rate, int channels)
+    : m_sample_rate(sample_rate), m_channels(channels), m_levels(1)
+{
+    m_peak = simd::peak_kernel();
+    m_pending.reserve(BASE_BLOCK * channels);
+}
+
+void PeakIndexBuilder::addBlock(const float* data, size_t samples)
+{
+    float lo, hi, sumsq;
+    m_peak(data, samples, &lo, &hi, &sumsq);
+    m_levels[0].push_back(Peak{quantize(lo), quantize(hi), quantize(std::sqrt(sumsq / samples))});
+}
+
+void PeakIndexBuilder::add(const float* data, size_t frames)
+{
+    auto start = std::chrono::steady_clock::now();
+    const size_t block = (size_t)BASE_BLOCK * m_channels;
+    size_t samples = frames * m_channels;
+    m_frames += frames;
+
+    if (!m_pending.empty())
+    {
+        size_t take = std::min(block - m_pending.size(), samples);
+        m_pending.insert(m_pending.end(), data, data + take);
+        data += take;
+        samples -= take;
+        if (m_pending.size() == block)
+        {
+            addBlock(m_pending.data(), block);
+            m_pending.clear();
+        }
+    }
+    for (; samples >= block; data += block, samples -= block)
+        addBlock(data, block);
+    m_pending.insert(m_pending.end(), data, data + samples);
+    m_build_ns += elapsed_ns(start);
+}
+
+void PeakIndexBuilder::add(const void* data, SampleType type, size_t frames)
+{
+    const uint8_t* src = (const uint8_t*)data;
+    m_convert.resize(CONVERT_FRAMES * m_channels);
+    while (frames > 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const size_t n = std::min(frames, CONVERT_FRAMES);
+        const size_t samples = n * m_channels;
+        float* dst = m_convert.data();
+        switch (type)
+        {
+        case SampleType::U8:
+            for (size_t i = 0; i < samples; i++)
+                dst[i] = (src[i] - 128) * (1.0f / 128.0f);
+            src += samples;
+            break;
+        case SampleType::S16:
+            for (size_t i = 0; i < samples; i++, src += 2)
+            {
+                int16_t v;
+                memcpy(&v, src, 2);
+                dst[i] = v * (1.0f / 32768.0f);
+            }
+            break;
+        case SampleType::S32:
+            for (size_t i = 0; i < samples; i++, src += 4)
+            {
+                int32_t v;
+                memcpy(&v, src, 4);
+                dst[i] = (float)(v * (1.0 / 2147483648.0));
+            }
+            break;
+        case SampleType::F32:
+            memcpy(dst, src, samples * 4);
+            src += samples * 4;
+            break;
+        case SampleType::F64:
+            for (size_t i = 0; i < samples; i++, src += 8)
+            {
+                double v;
+                memcpy(&v, src, 8);
+                dst[i] = (float)v;
+            }
+            break;
+        }
+        m_build_ns += elapsed_ns(start);
+        add(dst, n);
+        frames -= n;
+    }
+}
+
+void PeakIndexBuilder::finish()
+{
+    auto start = std::chrono::steady_clock::now();
+    if (!m_pending.empty())
+    {
+        addBlock(m_pending.data(), m_pending.size());
+        m_pending.clear();
+    }
+
+    // every level merges pairs of the one below, an odd peak out is carried over
+    m_levels.resize(1);
+    while (m_levels.back().size() > 1)
+    {
+        const std::vector<Peak>& src = m_levels.back();
+        std::vector<Peak> dst((src.size() + 1) / 2);
+        for (size_t i = 0; i < dst.size(); i++)
+        {
+            const Peak& a = src[2 * i];
+            const Peak& b = 2 * i + 1 < src.size() ? src[2 * i + 1] : a;
+            float rms = std::sqrt(((float)a.rms * a.rms + (float)b.rms * b.rms) * 0.5f);
+            dst[i] = Peak{std::min(a.min, b.min), std::max(a.max, b.max), (int16_t)std::lround(rms)};
+        }
+        m_levels.push_back(std::move(dst));
+    }
+    m_build_ns += elapsed_ns(start);
+}
+
+size_t PeakIndexBuilder::fileSize() const
+{
+    size_t size = sizeof(PeakFileHeader) + m_levels.size() * 2 * sizeof(uint64_t);
+    for (const auto& level : m_levels)
+        size += level.size() * sizeof(Peak);
+    return size;
+}
+
+bool PeakIndexBuilder::write(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open peak index file %s\n", path);
+        return false;
+    }
+
+    PeakFileHeader header{};
+    memcpy(header.magic, PEAK_MAGIC, sizeof(PEAK_MAGIC));
+    header.version = PEAK_VERSION;
+    header.sample_rate = m_sample_rate;
+    header.channels = m_channels;
+    header.base_block = BASE_BLOCK;
+    header.frames = m_frames;
+    header.levels = (uint32_t)m_levels.size();
+
+    std::vector<uint64_t> table;
+    uint64_t offset = sizeof(PeakFileHeader) + m_levels.size() * 2 * sizeof(uint64_t);
+    for (const auto& level : m_levels)
+    {
+        table.push_back(offset);
+        table.push_back(level.size());
+        offset += level.size() * sizeof(Peak);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(table.data(), sizeof(uint64_t), table.size(), file) == table.size();
+    for (const auto& level : m_levels)
+        ok = ok && fwrite(level.data(), sizeof(Peak), level.size(), file) == level.size();
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "Could not write peak index file %s\n", path);
+    return ok;
+}
+
+
+PeakIndex::~PeakIndex()
+{
+    close();
+}
+
+bool PeakIndex::open(const char* path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Could not open peak index file %s\n", path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view)
+    {
+        fprintf(stderr, "Could not map peak index file %s\n", path);
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open peak index file %s\n", path);
+        return false;
+    }
+    struct stat st;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (view == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map peak index file %s\n", path);
+        return false;
+    }
+    m_size = (size_t)st.st_size;
+#endif
+    m_data = (const uint8_t*)view;
+
+    // validate everything once so level() and query() can trust the table
+    PeakFileHeader header;
+    bool valid = m_size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, m_data, sizeof(header));
+        valid = memcmp(header.magic, PEAK_MAGIC, sizeof(PEAK_MAGIC)) == 0 && header.version == PEAK_VERSION &&
+                header.base_block == PeakIndexBuilder::BASE_BLOCK && header.levels > 0 &&
+                header.levels <= (m_size - sizeof(header)) / (2 * sizeof(uint64_t));
+    }
+    if (valid)
+    {
+        m_level_table = (const uint64_t*)(m_data + sizeof(header));
+        for (uint32_t i = 0; i < header.levels && valid; i++)
+        {
+            uint64_t offset = m_level_table[2 * i], count = m_level_table[2 * i + 1];
+            valid = offset <= m_size && count <= (m_size - offset) / sizeof(Peak);
+        }
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "Invalid peak index file %s\n", path);
+        close();
+        return false;
+    }
+
+    m_sample_rate = header.sample_rate;
+    m_channels = header.channels;
+    m_frames = header.frames;
+    m_level_count = header.levels;
+    return true;
+}
+
+void PeakIndex::close()
+{
+    if (m_data)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mapping);
+        CloseHandle((HANDLE)m_file);
+        m_file = m_mapping = nullptr;
+#else
+        munmap((void*)m_data, m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_sample_rate = m_channels = 0;
+    m_frames = 0;
+    m_level_count = 0;
+    m_level_table = nullptr;
+}
+
+const Peak* PeakIndex::level(size_t level, size_t* count) const
+{
+    if (level >= m_level_count)
+    {
+        *count = 0;
+        return nullptr;
+    }
+    *count = (size_t)m_level_table[2 * level + 1];
+    return (const Peak*)(m_data + m_level_table[2 * level]);
+}
+
+void PeakIndex::query(double t0, double t1, int pixels, std::vector<Peak>& out) const
+{
+    out.assign(std::max(pixels, 0), Peak{0, 0, 0});
+    if (!isOpen() || pixels <= 0 || t1 <= t0)
+        return;
+
+    // coarsest level whose peaks are still no wider than a pixel
+    const double frames_per_pixel = (t1 - t0) * m_sample_rate / pixels;
+    size_t lvl = 0;
+    while (lvl + 1 < m_level_count && (double)((uint64_t)PeakIndexBuilder::BASE_BLOCK << (lvl + 1)) <= frames_per_pixel)
+        lvl++;
+
+    size_t count;
+    const Peak* peaks = level(lvl, &count);
+    const double block = (double)((uint64_t)PeakIndexBuilder::BASE_BLOCK << lvl);
+    const double first = t0 * m_sample_rate;
+
+    for (int x = 0; x < pixels; x++)
+    {
+        double f0 = std::max(first + x * frames_per_pixel, 0.0);
+        double f1 = std::min(first + (x + 1) * frames_per_pixel, (double)m_frames);
+        if (f0 >= f1)
+            continue;
+
+        size_t b0 = (size_t)(f0 / block);
+        size_t b1 = std::max((size_t)std::ceil(f1 / block), b0 + 1);
+        b1 = std::min(b1, count);
+        if (b0 >= b1)
+            continue;
+
+        Peak p = peaks[b0];
+        float sumsq = (float)p.rms * p.rms;
+        for (size_t b = b0 + 1; b < b1; b++)
+        {
+            p.min = std::min(p.min, peaks[b].min);
+            p.max = std::max(p.max, peaks[b].max);
+            sumsq += (float)peaks[b].rms * peaks[b].rms;
+        }
+        p.rms = (int16_t)std::lround(std::sqrt(sumsq / (b1 - b0)));
+        out[x] = p;
+    }
+}
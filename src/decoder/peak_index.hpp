@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Multi-resolution min/max/RMS summary of an audio stream for drawing waveforms.
+//
+// Level 0 holds one Peak per BASE_BLOCK frames with all channels folded
+// together, every following level halves the one before until a single peak
+// is left, so the whole pyramid is about twice the size of level 0. It is
+// written to a sidecar file whose layout is used in place after mapping it
+// into memory: opening the index of a long file reads nothing up front and
+// query() touches at most a few peaks per pixel, whatever the zoom level.
+
+// amplitude scaled to -32767 .. 32767
+struct Peak
+{
+    int16_t min, max, rms;
+};
+
+class PeakIndexBuilder
+{
+public:
+    static constexpr uint32_t BASE_BLOCK = 256;
+
+    enum class SampleType
+    {
+        U8,
+        S16,
+        S32,
+        F32,
+        F64,
+    };
+
+    PeakIndexBuilder(int sample_rate, int channels);
+
+    // Adds `frames` interleaved frames in the machine's byte order.
+    void add(const void* data, SampleType type, size_t frames);
+    void add(const float* data, size_t frames);
+    // Closes the last partial block and builds the coarser levels.
+    void finish();
+    bool write(const char* path) const;
+
+    int sampleRate() const { return m_sample_rate; }
+    int channels() const { return m_channels; }
+    uint64_t frames() const { return m_frames; }
+    size_t levels() const { return m_levels.size(); }
+    // size of the sidecar file written by write()
+    size_t fileSize() const;
+    // time spent in add() and finish()
+    double buildMs() const { return m_build_ns / 1e6; }
+
+private:
+    void addBlock(const float* data, size_t samples);
+
+    int m_sample_rate, m_channels;
+    uint64_t m_frames = 0;
+    std::vector<float> m_pending; // partial block
+    std::vector<float> m_convert; // add() conversion buffer
+    std::vector<std::vector<Peak>> m_levels;
+    int64_t m_build_ns = 0;
+
+    void (*m_peak)(const float* x, size_t n, float* min, float* max, float* sumsq);
+};
+
+// Read side of a sidecar written by PeakIndexBuilder, memory mapped.
+class PeakIndex
+{
+public:
+    PeakIndex() = default;
+    ~PeakIndex();
+    PeakIndex(const PeakIndex&) = delete;
+    PeakIndex& operator=(const PeakIndex&) = delete;
+
+    bool open(const char* path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    int sampleRate() const { return m_sample_rate; }
+    int channels() const { return m_channels; }
+    uint64_t frames() const { return m_frames; }
+    double duration() const { return m_sample_rate ? (double)m_frames / m_sample_rate : 0.0; }
+    size_t fileSize() const { return m_size; }
+
+    size_t levels() const { return m_level_count; }
+    // Peaks of `level`, each one covering BASE_BLOCK << level frames.
+    const Peak* level(size_t level, size_t* count) const;
+
+    // Fills `out` with one peak per pixel for the time range [t0, t1) seconds.
+    // Pixels outside of the stream are left flat.
+    void query(double t0, double t1, int pixels, std::vector<Peak>& out) const;
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+
+    int m_sample_rate = 0;
+    int m_channels = 0;
+    uint64_t m_frames = 0;
+    size_t m_level_count = 0;
+    const uint64_t* m_level_table = nullptr; // offset, count per level
+};
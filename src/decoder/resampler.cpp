@@ -0,0 +1,148 @@
+#include "resampler.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Phase counts above this are approximated, the output rate is then off by
+// less than 0.1%
+static constexpr size_t MAX_PHASES = 1024;
+static constexpr double PI = 3.14159265358979323846;
+
+/* Filter design */
+
+// zeroth order modified Bessel function of the first kind
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+const char* Resampler::qualityName(Quality quality)
+{
+    switch (quality)
+    {
+        case Quality::Fast: return "fast";
+        case Quality::Medium: return "medium";
+        case Quality::High: return "high";
+    }
+    return "?";
+}
+
+Resampler::Resampler(int in_rate, int out_rate, int channels, Quality quality)
+    : m_in_rate(in_rate), m_out_rate(out_rate), m_channels(channels)
+{
+    double rolloff, beta;
+    switch (quality)
+    {
+        case Quality::Fast:   m_taps = 16; rolloff = 0.85; beta = 6.0; break;
+        case Quality::Medium: m_taps = 32; rolloff = 0.91; beta = 8.0; break;
+        default:              m_taps = 64; rolloff = 0.95; beta = 10.0; break;
+    }
+
+    size_t g = std::gcd(in_rate, out_rate);
+    m_phases = out_rate / g;
+    m_step = in_rate / g;
+    if (m_phases > MAX_PHASES)
+    {
+        m_step = (size_t)std::llround((double)m_step * MAX_PHASES / m_phases);
+        m_phases = MAX_PHASES;
+    }
+
+    // cutoff relative to the input rate, below the lower of both nyquists
+    const double fc = 0.5 * std::min(1.0, (double)m_phases / m_step) * rolloff;
+    const double half = m_taps / 2.0;
+    const double i0_beta = bessel_i0(beta);
+
+    // coefficient j of phase p weights input sample base + j for an output
+    // located p/L samples after input sample base + taps/2 - 1
+    m_coeffs.resize(m_phases * m_taps);
+    for (size_t p = 0; p < m_phases; p++)
+    {
+        float* c = &m_coeffs[p * m_taps];
+        double sum = 0.0;
+        for (size_t j = 0; j < m_taps; j++)
+        {
+            double x = (double)p / m_phases + half - 1.0 - (double)j;
+            double u = 2.0 * fc * x;
+            double sinc = std::abs(u) < 1e-9 ? 1.0 : std::sin(PI * u) / (PI * u);
+            double r = x / half;
+            double window = std::abs(r) >= 1.0 ? 0.0 : bessel_i0(beta * std::sqrt(1.0 - r * r)) / i0_beta;
+            double v = 2.0 * fc * sinc * window;
+            c[j] = (float)v;
+            sum += v;
+        }
+        // unity gain at DC for every phase
+        for (size_t j = 0; j < m_taps; j++)
+            c[j] = (float)(c[j] / sum);
+    }
+
+    m_dot = simd::dot_kernel();
+    m_kernel_name = simd::dot_kernel_name();
+
+    reset();
+}
+
+void Resampler::reset()
+{
+    // prime with zeros so that the first output lines up with the first input
+    m_history.assign(m_channels, std::vector<float>(m_taps / 2 - 1, 0.0f));
+    m_pos = (m_taps / 2 - 1) * m_phases;
+}
+
+size_t Resampler::process(const float* in, size_t in_frames, std::vector<float>& out)
+{
+    // deinterleave into the per channel history
+    for (int ch = 0; ch < m_channels; ch++)
+    {
+        auto& hist = m_history[ch];
+        size_t old = hist.size();
+        hist.resize(old + in_frames);
+        for (size_t i = 0; i < in_frames; i++)
+            hist[old + i] = in[i * m_channels + ch];
+    }
+
+    const size_t available = m_history[0].size();
+    const size_t lead = m_taps / 2 - 1;
+
+    // count the outputs whose filter window is fully inside the history
+    size_t frames = 0;
+    for (size_t pos = m_pos; pos / m_phases - lead + m_taps <= available; pos += m_step)
+        frames++;
+
+    size_t first = out.size();
+    out.resize(first + frames * m_channels);
+    float* dst = out.data() + first;
+    for (size_t n = 0; n < frames; n++)
+    {
+        size_t base = m_pos / m_phases - lead;
+        const float* c = &m_coeffs[(m_pos % m_phases) * m_taps];
+        for (int ch = 0; ch < m_channels; ch++)
+            *dst++ = m_dot(m_history[ch].data() + base, c, m_taps);
+        m_pos += m_step;
+    }
+
+    // drop the input no future output will look at
+    size_t consumed = std::min(m_pos / m_phases - lead, available);
+    if (consumed > 0)
+    {
+        for (auto& hist : m_history)
+            hist.erase(hist.begin(), hist.begin() + consumed);
+        m_pos -= consumed * m_phases;
+    }
+    return frames;
+}
+
+size_t Resampler::flush(std::vector<float>& out)
+{
+    std::vector<float> silence((m_taps / 2) * m_channels, 0.0f);
+    return process(silence.data(), m_taps / 2, out);
+}
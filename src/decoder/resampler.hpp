@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Streaming polyphase resampler for interleaved float samples.
+//
+// The conversion ratio is reduced to L/M (e.g. 160/147 for 44.1k -> 48k) and a
+// windowed sinc low-pass is split into L phases of `taps` coefficients each.
+// Every output sample is a single dot product between the input history and
+// one phase, which is where the AVX2/SSE/NEON kernels come in.
+class Resampler
+{
+public:
+    enum class Quality
+    {
+        Fast,   // 16 taps per phase
+        Medium, // 32 taps per phase
+        High,   // 64 taps per phase
+    };
+
+    Resampler(int in_rate, int out_rate, int channels, Quality quality = Quality::Medium);
+
+    // Resamples `in_frames` frames and appends the result to `out`.
+    // Returns the number of frames appended.
+    size_t process(const float* in, size_t in_frames, std::vector<float>& out);
+    // Pushes out the samples still held back by the filter delay.
+    size_t flush(std::vector<float>& out);
+    void reset();
+
+    int inRate() const { return m_in_rate; }
+    int outRate() const { return m_out_rate; }
+    int channels() const { return m_channels; }
+    // name of the dot product kernel in use ("avx2", "sse", "neon" or "scalar")
+    const char* kernelName() const { return m_kernel_name; }
+
+    static const char* qualityName(Quality quality);
+
+private:
+    int m_in_rate, m_out_rate, m_channels;
+    size_t m_taps;     // coefficients per phase, multiple of 8
+    size_t m_phases;   // L
+    size_t m_step;     // M
+    std::vector<float> m_coeffs; // m_phases * m_taps
+
+    // per channel input history; m_pos is the position of the next output
+    // sample in units of 1/L input samples relative to the history start
+    std::vector<std::vector<float>> m_history;
+    size_t m_pos;
+
+    float (*m_dot)(const float* a, const float* b, size_t n);
+    const char* m_kernel_name;
+};
@@ -0,0 +1,495 @@
+#include "simd.hpp"
+
+namespace simd {
+
+/* Dot product kernels, any n */
+
+[[maybe_unused]] static float dot_scalar(const float* a, const float* b, size_t n)
+{
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += a[i + 0] * b[i + 0];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef SIMD_SSE
+static float dot_sse(const float* a, const float* b, size_t n)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 s = _mm_add_ps(s0, s1);
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    float sum = _mm_cvtss_f32(s);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 static float dot_avx2(const float* a, const float* b, size_t n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+    }
+    if (i + 8 <= n)
+    {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        i += 8;
+    }
+    __m256 s8 = _mm256_add_ps(s0, s1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    float sum = _mm_cvtss_f32(s);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+#ifdef SIMD_NEON
+static float dot_neon(const float* a, const float* b, size_t n)
+{
+    float32x4_t s0 = vdupq_n_f32(0.0f), s1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+        s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t s = vaddq_f32(s0, s1);
+    float32x2_t s2 = vadd_f32(vget_low_f32(s), vget_high_f32(s));
+    float sum = vget_lane_f32(vpadd_f32(s2, s2), 0);
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+/* Peak kernels, any n > 0 */
+
+[[maybe_unused]] static void peak_scalar(const float* x, size_t n, float* min, float* max, float* sumsq)
+{
+    float lo = x[0], hi = x[0], sq = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+        sq += x[i] * x[i];
+    }
+    *min = lo;
+    *max = hi;
+    *sumsq = sq;
+}
+
+#ifdef SIMD_SSE
+static void peak_sse(const float* x, size_t n, float* min, float* max, float* sumsq)
+{
+    __m128 lo = _mm_set1_ps(x[0]), hi = lo, sq = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(x + i);
+        lo = _mm_min_ps(lo, v);
+        hi = _mm_max_ps(hi, v);
+        sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+    }
+    lo = _mm_min_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_min_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    hi = _mm_max_ps(hi, _mm_movehl_ps(hi, hi));
+    hi = _mm_max_ss(hi, _mm_shuffle_ps(hi, hi, 1));
+    sq = _mm_add_ps(sq, _mm_movehl_ps(sq, sq));
+    sq = _mm_add_ss(sq, _mm_shuffle_ps(sq, sq, 1));
+    float l = _mm_cvtss_f32(lo), h = _mm_cvtss_f32(hi), s = _mm_cvtss_f32(sq);
+    for (; i < n; i++)
+    {
+        l = x[i] < l ? x[i] : l;
+        h = x[i] > h ? x[i] : h;
+        s += x[i] * x[i];
+    }
+    *min = l;
+    *max = h;
+    *sumsq = s;
+}
+#endif
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 static void peak_avx2(const float* x, size_t n, float* min, float* max, float* sumsq)
+{
+    __m256 lo = _mm256_set1_ps(x[0]), hi = lo, sq = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(x + i);
+        lo = _mm256_min_ps(lo, v);
+        hi = _mm256_max_ps(hi, v);
+        sq = _mm256_fmadd_ps(v, v, sq);
+    }
+    __m128 l4 = _mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1));
+    __m128 h4 = _mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1));
+    __m128 s4 = _mm_add_ps(_mm256_castps256_ps128(sq), _mm256_extractf128_ps(sq, 1));
+    l4 = _mm_min_ps(l4, _mm_movehl_ps(l4, l4));
+    l4 = _mm_min_ss(l4, _mm_shuffle_ps(l4, l4, 1));
+    h4 = _mm_max_ps(h4, _mm_movehl_ps(h4, h4));
+    h4 = _mm_max_ss(h4, _mm_shuffle_ps(h4, h4, 1));
+    s4 = _mm_add_ps(s4, _mm_movehl_ps(s4, s4));
+    s4 = _mm_add_ss(s4, _mm_shuffle_ps(s4, s4, 1));
+    float l = _mm_cvtss_f32(l4), h = _mm_cvtss_f32(h4), s = _mm_cvtss_f32(s4);
+    for (; i < n; i++)
+    {
+        l = x[i] < l ? x[i] : l;
+        h = x[i] > h ? x[i] : h;
+        s += x[i] * x[i];
+    }
+    *min = l;
+    *max = h;
+    *sumsq = s;
+}
+#endif
+
+#ifdef SIMD_NEON
+static void peak_neon(const float* x, size_t n, float* min, float* max, float* sumsq)
+{
+    float32x4_t lo = vdupq_n_f32(x[0]), hi = lo, sq = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t v = vld1q_f32(x + i);
+        lo = vminq_f32(lo, v);
+        hi = vmaxq_f32(hi, v);
+        sq = vmlaq_f32(sq, v, v);
+    }
+    float32x2_t l2 = vpmin_f32(vget_low_f32(lo), vget_high_f32(lo));
+    float32x2_t h2 = vpmax_f32(vget_low_f32(hi), vget_high_f32(hi));
+    float32x2_t s2 = vadd_f32(vget_low_f32(sq), vget_high_f32(sq));
+    float l = vget_lane_f32(vpmin_f32(l2, l2), 0);
+    float h = vget_lane_f32(vpmax_f32(h2, h2), 0);
+    float s = vget_lane_f32(vpadd_f32(s2, s2), 0);
+    for (; i < n; i++)
+    {
+        l = x[i] < l ? x[i] : l;
+        h = x[i] > h ? x[i] : h;
+        s += x[i] * x[i];
+    }
+    *min = l;
+    *max = h;
+    *sumsq = s;
+}
+#endif
+
+/* Block compression kernels, 16 RGBA pixels */
+
+[[maybe_unused]] static void moments_scalar(const uint8_t* px, int sum[3], int products[6])
+{
+    int s[3] = {0, 0, 0};
+    int p[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++, px += 4)
+    {
+        const int r = px[0], g = px[1], b = px[2];
+        s[0] += r;
+        s[1] += g;
+        s[2] += b;
+        p[0] += r * r;
+        p[1] += r * g;
+        p[2] += r * b;
+        p[3] += g * g;
+        p[4] += g * b;
+        p[5] += b * b;
+    }
+    for (int c = 0; c < 3; c++)
+        sum[c] = s[c];
+    for (int c = 0; c < 6; c++)
+        products[c] = p[c];
+}
+
+[[maybe_unused]] static void project_scalar(const uint8_t* px, const float origin[3], const float dir[3], float scale,
+                                            float t[16])
+{
+    for (int i = 0; i < 16; i++, px += 4)
+        t[i] = (((float)px[0] - origin[0]) * dir[0] + ((float)px[1] - origin[1]) * dir[1] +
+                ((float)px[2] - origin[2]) * dir[2]) * scale;
+}
+
+#ifdef SIMD_SSE2
+static int hsum_epi32(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// Channels of 4 pixels split into 32 bit lanes. The products use madd on
+// lanes whose upper 16 bits are zero, which is an exact 32 bit multiply.
+static void moments_sse2(const uint8_t* px, int sum[3], int products[6])
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i s[3], p[6];
+    for (__m128i& v : s)
+        v = _mm_setzero_si128();
+    for (__m128i& v : p)
+        v = _mm_setzero_si128();
+    for (int i = 0; i < 64; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i));
+        const __m128i r = _mm_and_si128(v, mask);
+        const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+        const __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+        s[0] = _mm_add_epi32(s[0], r);
+        s[1] = _mm_add_epi32(s[1], g);
+        s[2] = _mm_add_epi32(s[2], b);
+        p[0] = _mm_add_epi32(p[0], _mm_madd_epi16(r, r));
+        p[1] = _mm_add_epi32(p[1], _mm_madd_epi16(r, g));
+        p[2] = _mm_add_epi32(p[2], _mm_madd_epi16(r, b));
+        p[3] = _mm_add_epi32(p[3], _mm_madd_epi16(g, g));
+        p[4] = _mm_add_epi32(p[4], _mm_madd_epi16(g, b));
+        p[5] = _mm_add_epi32(p[5], _mm_madd_epi16(b, b));
+    }
+    for (int c = 0; c < 3; c++)
+        sum[c] = hsum_epi32(s[c]);
+    for (int c = 0; c < 6; c++)
+        products[c] = hsum_epi32(p[c]);
+}
+
+static void project_sse2(const uint8_t* px, const float origin[3], const float dir[3], float scale, float t[16])
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 o0 = _mm_set1_ps(origin[0]), o1 = _mm_set1_ps(origin[1]), o2 = _mm_set1_ps(origin[2]);
+    const __m128 d0 = _mm_set1_ps(dir[0]), d1 = _mm_set1_ps(dir[1]), d2 = _mm_set1_ps(dir[2]);
+    const __m128 sc = _mm_set1_ps(scale);
+    for (int i = 0; i < 16; i += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i * 4));
+        const __m128 r = _mm_cvtepi32_ps(_mm_and_si128(v, mask));
+        const __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask));
+        const __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask));
+        __m128 d = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(r, o0), d0), _mm_mul_ps(_mm_sub_ps(g, o1), d1));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(b, o2), d2));
+        _mm_storeu_ps(t + i, _mm_mul_ps(d, sc));
+    }
+}
+#endif
+
+#ifdef SIMD_X86
+SIMD_TARGET_AVX2 static int hsum_epi32_avx2(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+// same as the SSE2 kernel, 8 pixels at a time
+SIMD_TARGET_AVX2 static void moments_avx2(const uint8_t* px, int sum[3], int products[6])
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i s[3], p[6];
+    for (__m256i& v : s)
+        v = _mm256_setzero_si256();
+    for (__m256i& v : p)
+        v = _mm256_setzero_si256();
+    for (int i = 0; i < 64; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i));
+        const __m256i r = _mm256_and_si256(v, mask);
+        const __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+        const __m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+        s[0] = _mm256_add_epi32(s[0], r);
+        s[1] = _mm256_add_epi32(s[1], g);
+        s[2] = _mm256_add_epi32(s[2], b);
+        p[0] = _mm256_add_epi32(p[0], _mm256_madd_epi16(r, r));
+        p[1] = _mm256_add_epi32(p[1], _mm256_madd_epi16(r, g));
+        p[2] = _mm256_add_epi32(p[2], _mm256_madd_epi16(r, b));
+        p[3] = _mm256_add_epi32(p[3], _mm256_madd_epi16(g, g));
+        p[4] = _mm256_add_epi32(p[4], _mm256_madd_epi16(g, b));
+        p[5] = _mm256_add_epi32(p[5], _mm256_madd_epi16(b, b));
+    }
+    for (int c = 0; c < 3; c++)
+        sum[c] = hsum_epi32_avx2(s[c]);
+    for (int c = 0; c < 6; c++)
+        products[c] = hsum_epi32_avx2(p[c]);
+}
+
+// multiplies and adds kept separate, an FMA would round differently
+SIMD_TARGET_AVX2_NO_FMA static void project_avx2(const uint8_t* px, const float origin[3], const float dir[3], float scale,
+                                                 float t[16])
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 o0 = _mm256_set1_ps(origin[0]), o1 = _mm256_set1_ps(origin[1]), o2 = _mm256_set1_ps(origin[2]);
+    const __m256 d0 = _mm256_set1_ps(dir[0]), d1 = _mm256_set1_ps(dir[1]), d2 = _mm256_set1_ps(dir[2]);
+    const __m256 sc = _mm256_set1_ps(scale);
+    for (int i = 0; i < 16; i += 8)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i * 4));
+        const __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(v, mask));
+        const __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask));
+        const __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+        __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(r, o0), d0), _mm256_mul_ps(_mm256_sub_ps(g, o1), d1));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_sub_ps(b, o2), d2));
+        _mm256_storeu_ps(t + i, _mm256_mul_ps(d, sc));
+    }
+}
+#endif
+
+#ifdef SIMD_NEON
+static int hsum_u16(uint16x8_t v)
+{
+    const uint64x2_t s = vpaddlq_u32(vpaddlq_u16(v));
+    return (int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+}
+
+// vld4 splits the block into one register per channel; byte products fit
+// 16 bits, summing them is widened
+static void moments_neon(const uint8_t* px, int sum[3], int products[6])
+{
+    const uint8x16x4_t v = vld4q_u8(px);
+    const uint8x16_t r = v.val[0], g = v.val[1], b = v.val[2];
+    sum[0] = hsum_u16(vpaddlq_u8(r));
+    sum[1] = hsum_u16(vpaddlq_u8(g));
+    sum[2] = hsum_u16(vpaddlq_u8(b));
+    auto dot = [](uint8x16_t x, uint8x16_t y) {
+        return hsum_u16(vmull_u8(vget_low_u8(x), vget_low_u8(y))) + hsum_u16(vmull_u8(vget_high_u8(x), vget_high_u8(y)));
+    };
+    products[0] = dot(r, r);
+    products[1] = dot(r, g);
+    products[2] = dot(r, b);
+    products[3] = dot(g, g);
+    products[4] = dot(g, b);
+    products[5] = dot(b, b);
+}
+
+// vmul + vadd like the other kernels
+static void project_neon(const uint8_t* px, const float origin[3], const float dir[3], float scale, float t[16])
+{
+    const uint8x16x4_t v = vld4q_u8(px);
+    const float32x4_t o0 = vdupq_n_f32(origin[0]), o1 = vdupq_n_f32(origin[1]), o2 = vdupq_n_f32(origin[2]);
+    const float32x4_t d0 = vdupq_n_f32(dir[0]), d1 = vdupq_n_f32(dir[1]), d2 = vdupq_n_f32(dir[2]);
+    const float32x4_t sc = vdupq_n_f32(scale);
+    uint16x8_t wide[3][2];
+    for (int c = 0; c < 3; c++)
+    {
+        wide[c][0] = vmovl_u8(vget_low_u8(v.val[c]));
+        wide[c][1] = vmovl_u8(vget_high_u8(v.val[c]));
+    }
+    for (int i = 0; i < 16; i += 4)
+    {
+        auto channel = [&](int c) {
+            const uint16x8_t w = wide[c][i / 8];
+            return vcvtq_f32_u32(vmovl_u16((i & 4) ? vget_high_u16(w) : vget_low_u16(w)));
+        };
+        float32x4_t d = vaddq_f32(vmulq_f32(vsubq_f32(channel(0), o0), d0), vmulq_f32(vsubq_f32(channel(1), o1), d1));
+        d = vaddq_f32(d, vmulq_f32(vsubq_f32(channel(2), o2), d2));
+        vst1q_f32(t + i, vmulq_f32(d, sc));
+    }
+}
+#endif
+
+DotFn dot_kernel()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return dot_avx2;
+#endif
+#if defined(SIMD_SSE)
+    return dot_sse;
+#elif defined(SIMD_NEON)
+    return dot_neon;
+#else
+    return dot_scalar;
+#endif
+}
+
+const char* dot_kernel_name()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return "avx2";
+#endif
+#if defined(SIMD_SSE)
+    return "sse";
+#elif defined(SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+PeakFn peak_kernel()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return peak_avx2;
+#endif
+#if defined(SIMD_SSE)
+    return peak_sse;
+#elif defined(SIMD_NEON)
+    return peak_neon;
+#else
+    return peak_scalar;
+#endif
+}
+
+MomentsFn moments_kernel()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return moments_avx2;
+#endif
+#if defined(SIMD_SSE2)
+    return moments_sse2;
+#elif defined(SIMD_NEON)
+    return moments_neon;
+#else
+    return moments_scalar;
+#endif
+}
+
+ProjectFn project_kernel()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return project_avx2;
+#endif
+#if defined(SIMD_SSE2)
+    return project_sse2;
+#elif defined(SIMD_NEON)
+    return project_neon;
+#else
+    return project_scalar;
+#endif
+}
+
+const char* block_kernel_name()
+{
+#if defined(SIMD_X86)
+    if (cpu_has_avx2())
+        return "avx2";
+#endif
+#if defined(SIMD_SSE2)
+    return "sse2";
+#elif defined(SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+} // namespace simd
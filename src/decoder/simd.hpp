@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Helpers for runtime SIMD dispatch.
+//
+// Kernels are compiled for several instruction sets in the same translation
+// unit (SIMD_TARGET_AVX2 enables AVX2/FMA code generation for one function on
+// GCC/Clang, MSVC accepts the intrinsics anywhere) and the best one is picked
+// once at runtime with cpu_has_avx2().
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SIMD_SSE 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX2_NO_FMA
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+// for kernels that have to round like the scalar code: with FMA enabled GCC
+// contracts a multiply followed by an add into one
+#define SIMD_TARGET_AVX2_NO_FMA __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace simd {
+
+inline bool cpu_has_avx2() {
+#if defined(SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, 0, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuidex(info, 1, 0);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(SIMD_X86)
+    static const bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return has;
+#else
+    return false;
+#endif
+}
+
+using DotFn = float (*)(const float* a, const float* b, size_t n);
+
+// Best float dot product kernel for this cpu and its name
+// ("avx2", "sse", "neon" or "scalar").
+DotFn dot_kernel();
+const char* dot_kernel_name();
+
+// Minimum, maximum and sum of squares of n floats, n > 0.
+using PeakFn = void (*)(const float* x, size_t n, float* min, float* max, float* sumsq);
+
+PeakFn peak_kernel();
+
+// Block compression kernels over one 4x4 block of RGBA pixels (64 bytes,
+// alpha ignored).
+//
+// Channel sums and the products rr rg rb gg gb bb summed over the block; the
+// sums are exact, so every kernel gives the same result.
+using MomentsFn = void (*)(const uint8_t* px, int sum[3], int products[6]);
+// Position of every pixel along `dir` from `origin`, times `scale`:
+// t[i] = ((r - origin[0]) * dir[0] + (g - origin[1]) * dir[1] + (b - origin[2]) * dir[2]) * scale,
+// evaluated in that order with separate multiplies and adds, so on x86 every
+// kernel gives the same result as the scalar code.
+using ProjectFn = void (*)(const uint8_t* px, const float origin[3], const float dir[3], float scale, float t[16]);
+
+MomentsFn moments_kernel();
+ProjectFn project_kernel();
+// "avx2", "sse2", "neon" or "scalar"
+const char* block_kernel_name();
+
+} // namespace simd
@@ -0,0 +1,62 @@
+#include "thumbnail.hpp"
+#include "video_reader.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+bool decodeThumbnail(const char* filename, int max_size, Thumbnail& out)
+{
+    std::unique_ptr<VideoReader> reader;
+    try
+    {
+        // converted straight into out.pixels, and called from file dialog workers
+        reader = std::make_unique<VideoReader>(filename, VIDEO_READER_NO_FRAME_BUFFER | VIDEO_READER_QUIET);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    VideoReaderState& state = reader->videoReaderState;
+    if (state.width <= 0 || state.height <= 0)
+        return false;
+
+    // keyframes decode without references, everything else is skipped
+    state.av_codec_ctx->skip_frame = AVDISCARD_NONKEY;
+
+    const AVStream* stream = state.av_format_ctx->streams[state.video_stream_index];
+    int64_t duration = stream->duration;
+    if (duration == AV_NOPTS_VALUE && state.av_format_ctx->duration != AV_NOPTS_VALUE)
+        duration = av_rescale_q(state.av_format_ctx->duration, av_get_time_base_q(), stream->time_base);
+    bool seeked = false;
+    if (duration != AV_NOPTS_VALUE && duration > 0)
+    {
+        const int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        seeked = av_seek_frame(state.av_format_ctx, state.video_stream_index, start + duration / 10,
+                               AVSEEK_FLAG_BACKWARD) >= 0;
+        if (seeked)
+            avcodec_flush_buffers(state.av_codec_ctx);
+    }
+    if (!reader->video_reader_decode_frame())
+    {
+        // files that seek badly still have a first frame
+        if (!seeked || av_seek_frame(state.av_format_ctx, state.video_stream_index, 0, AVSEEK_FLAG_BACKWARD) < 0)
+            return false;
+        avcodec_flush_buffers(state.av_codec_ctx);
+        if (!reader->video_reader_decode_frame())
+            return false;
+    }
+
+    // fit the long side into max_size, never scaling up
+    const double scale = std::min(1.0, (double)max_size / std::max(state.width, state.height));
+    out.width = std::max(1, (int)(state.width * scale + 0.5));
+    out.height = std::max(1, (int)(state.height * scale + 0.5));
+
+    const AVPixelFormat rgba = AV_PIX_FMT_RGBA;
+    reader->video_reader_set_output_formats(&rgba, 1);
+    reader->video_reader_set_output_size(out.width, out.height);
+    out.pixels.resize((size_t)out.width * out.height * 4);
+    uint8_t* dest[4] = { out.pixels.data(), nullptr, nullptr, nullptr };
+    const int dest_linesize[4] = { out.width * 4, 0, 0, 0 };
+    return reader->video_reader_convert_frame(dest, dest_linesize);
+}
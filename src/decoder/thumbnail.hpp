@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A small still of a video file for file browsers: the first keyframe about a
+// tenth into the file (the very first frame is often black), scaled down to
+// fit a box and converted to RGBA.
+struct Thumbnail
+{
+    std::vector<uint8_t> pixels; // RGBA, width * 4 bytes per row
+    int width = 0;
+    int height = 0;
+};
+
+// Decodes the thumbnail of `filename` at most max_size pixels on its long
+// side. Only keyframes are decoded, so this is one frame's worth of decoding
+// plus a seek. False if the file has no decodable video. Thread safe, every
+// call opens its own reader.
+bool decodeThumbnail(const char* filename, int max_size, Thumbnail& out);
@@ -0,0 +1,162 @@
+#include "time_stretch.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double FRAME_SEC = 0.020;  // 20 ms frames
+static constexpr double SEARCH_SEC = 0.006; // +-6 ms search
+
+TimeStretch::TimeStretch(int sample_rate, int channels)
+    : m_channels(channels)
+{
+    // even frame length so the output hop is exact
+    m_frame = (size_t)(sample_rate * FRAME_SEC) & ~(size_t)1;
+    m_hop = m_frame / 2;
+    m_search = (size_t)(sample_rate * SEARCH_SEC);
+
+    // periodic Hann, overlapping halves sum to exactly one
+    m_window.resize(m_frame);
+    for (size_t i = 0; i < m_frame; i++)
+        m_window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * 3.14159265358979323846 * i / m_frame));
+
+    m_dot = simd::dot_kernel();
+    reset();
+}
+
+void TimeStretch::setSpeed(double speed)
+{
+    m_speed = std::clamp(speed, 0.25, 4.0);
+}
+
+void TimeStretch::reset()
+{
+    // start with half a frame of silence, the first frame then fades in the
+    // input the same way every later frame overlaps the previous one; its
+    // silent first half is never emitted, so the output doesn't lag the input
+    m_input.assign(m_hop * m_channels, 0.0f);
+    m_mono.assign(m_hop, 0.0f);
+    m_overlap.assign(m_hop * m_channels, 0.0f);
+    m_nominal = 0.0;
+    m_prev = 0;
+    m_first = true;
+}
+
+// shift around `nominal` whose frame correlates best with the continuation of
+// the previous frame
+size_t TimeStretch::bestOffset(size_t nominal) const
+{
+    const size_t target = m_prev + m_hop;
+    const size_t lo = nominal > m_search ? nominal - m_search : 0;
+    const size_t hi = nominal + m_search;
+    const float* tmpl = m_mono.data() + target;
+    const size_t n = m_hop; // only the overlapping half matters
+
+    // energy of the candidate window, slid along instead of recomputed
+    double energy = 0.0;
+    for (size_t i = 0; i < n; i++)
+        energy += (double)m_mono[lo + i] * m_mono[lo + i];
+
+    // start from the nominal position, so only a strictly better match moves
+    // the frame and silence or a tie keeps it where it was
+    size_t best = nominal;
+    double bestScore = m_dot(tmpl, m_mono.data() + nominal, n) /
+                       std::sqrt(m_dot(m_mono.data() + nominal, m_mono.data() + nominal, n) + 1e-9);
+    for (size_t k = lo; k <= hi; k++)
+    {
+        double corr = m_dot(tmpl, m_mono.data() + k, n);
+        double score = corr / std::sqrt(energy + 1e-9);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = k;
+        }
+        energy += (double)m_mono[k + n] * m_mono[k + n] - (double)m_mono[k] * m_mono[k];
+        energy = std::max(energy, 0.0);
+    }
+    return best;
+}
+
+// takes one input frame if enough input is buffered, emits one hop of output
+bool TimeStretch::nextFrame(std::vector<float>& out)
+{
+    const size_t available = m_mono.size();
+    const size_t nominal = (size_t)std::lround(m_nominal);
+    if (nominal + m_search + m_frame + 1 > available || m_prev + m_hop + m_hop > available)
+        return false;
+
+    const bool first = m_first;
+    size_t k = first ? nominal : bestOffset(nominal);
+    m_first = false;
+
+    // first half completes the previous frame's overlap, second half is kept
+    const float* src = m_input.data() + k * m_channels;
+    if (!first)
+    {
+        const size_t start = out.size();
+        out.resize(start + m_hop * m_channels);
+        float* dst = out.data() + start;
+        for (size_t i = 0; i < m_hop * m_channels; i++)
+            dst[i] = m_overlap[i] + src[i] * m_window[i / m_channels];
+    }
+    for (size_t i = 0; i < m_hop; i++)
+        for (int ch = 0; ch < m_channels; ch++)
+        {
+            size_t idx = i * m_channels + ch;
+            m_overlap[idx] = src[m_hop * m_channels + idx] * m_window[m_hop + i];
+        }
+
+    m_prev = k;
+    m_nominal += m_hop * m_speed;
+    return true;
+}
+
+size_t TimeStretch::process(const float* in, size_t in_frames, std::vector<float>& out)
+{
+    m_input.insert(m_input.end(), in, in + in_frames * m_channels);
+    const size_t old = m_mono.size();
+    m_mono.resize(old + in_frames);
+    for (size_t i = 0; i < in_frames; i++)
+    {
+        float sum = 0.0f;
+        for (int ch = 0; ch < m_channels; ch++)
+            sum += in[i * m_channels + ch];
+        m_mono[old + i] = sum / m_channels;
+    }
+
+    const size_t before = out.size();
+    while (nextFrame(out))
+        ;
+    const size_t frames = (out.size() - before) / m_channels;
+
+    // drop the input neither the search nor the template will reach again
+    size_t keep_from = std::min(m_prev + m_hop, (size_t)std::max(0.0, m_nominal - (double)m_search));
+    if (keep_from > 0)
+    {
+        m_input.erase(m_input.begin(), m_input.begin() + keep_from * m_channels);
+        m_mono.erase(m_mono.begin(), m_mono.begin() + keep_from);
+        m_prev -= keep_from;
+        m_nominal -= (double)keep_from;
+    }
+    return frames;
+}
+
+size_t TimeStretch::flush(std::vector<float>& out)
+{
+    std::vector<float> silence((m_frame + 2 * m_search) * m_channels, 0.0f);
+    size_t frames = process(silence.data(), m_frame + 2 * m_search, out);
+    reset();
+    return frames;
+}
+
+size_t TimeStretch::drain(std::vector<float>& out)
+{
+    // the last frame's faded out half plus the faded in start of the frame
+    // right after it add up to the input itself, so from there on the input
+    // continues unchanged
+    const size_t from = (m_prev + m_hop) * m_channels;
+    const size_t frames = (m_input.size() - from) / m_channels;
+    out.insert(out.end(), m_input.begin() + from, m_input.end());
+    reset();
+    return frames;
+}
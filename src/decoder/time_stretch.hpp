@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Pitch preserving time stretching with WSOLA (waveform similarity overlap-add).
+//
+// Output is built from Hann windowed frames of N samples placed every N/2
+// samples. Input frames are taken every N/2 * speed samples, each one shifted
+// by up to +-`search` samples to the position whose waveform best matches the
+// natural continuation of the previous frame, so the overlap adds up without
+// phase cancellation. The search correlates a mono downmix with the SIMD dot
+// product kernel.
+class TimeStretch
+{
+public:
+    TimeStretch(int sample_rate, int channels);
+
+    // 0.5 .. 3.0 are the intended limits, 1.0 reproduces the input
+    void setSpeed(double speed);
+    double speed() const { return m_speed; }
+
+    // Stretches `in_frames` interleaved frames and appends the result to `out`.
+    // Returns the number of frames appended.
+    size_t process(const float* in, size_t in_frames, std::vector<float>& out);
+    // Pushes out the input still held back for the search and the overlap.
+    size_t flush(std::vector<float>& out);
+    // Like flush(), but hands out the held back input unstretched and without
+    // trailing silence, for continuing seamlessly without the stretcher.
+    size_t drain(std::vector<float>& out);
+    void reset();
+
+private:
+    bool nextFrame(std::vector<float>& out);
+    size_t bestOffset(size_t nominal) const;
+
+    int m_channels;
+    size_t m_frame;   // N
+    size_t m_hop;     // N / 2, the output hop
+    size_t m_search;  // maximum shift of an input frame
+    double m_speed = 1.0;
+
+    std::vector<float> m_window;
+    std::vector<float> m_input; // interleaved
+    std::vector<float> m_mono;
+    std::vector<float> m_overlap; // second half of the last output frame
+
+    double m_nominal;  // where the next frame would be taken without search
+    size_t m_prev;     // where the last frame was taken from
+    bool m_first;
+
+    float (*m_dot)(const float* a, const float* b, size_t n);
+};
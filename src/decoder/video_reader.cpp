@@ -1,14 +1,40 @@
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
 #include <stdexcept>
+#include <cstdlib>
 #include "video_reader.hpp"
+#include "worker_pool.hpp"
 
 // av_err2str returns a temporary array. This doesn't work in gcc.
 // This function can be used as a replacement for av_err2str.
 static const char* av_make_error(int errnum) {
-    static char str[AV_ERROR_MAX_STRING_SIZE];
+    // per thread, readers decode on several threads at once
+    static thread_local char str[AV_ERROR_MAX_STRING_SIZE];
     memset(str, 0, sizeof(str));
     return av_make_error_string(str, AV_ERROR_MAX_STRING_SIZE, errnum);
 }
 
+// _aligned_malloc only exists on Windows, posix_memalign everywhere else
+static uint8_t* alloc_frame_buffer(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, alignment));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0)
+        return nullptr;
+    return static_cast<uint8_t*>(ptr);
+#endif
+}
+
+static void free_frame_buffer(uint8_t* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
 static AVPixelFormat correct_for_deprecated_pixel_format(AVPixelFormat pix_fmt) {
     // Fix swscaler deprecated pixel format warning
     // (YUVJ has been deprecated, change pixel format to regular YUV)
@@ -22,19 +48,204 @@ static AVPixelFormat correct_for_deprecated_pixel_format(AVPixelFormat pix_fmt)
 }
 
 bool VideoReader::video_reader_read_frame() {
+    if (!frame_buffer || !video_reader_decode_frame()) {
+        return false;
+    }
+    uint8_t* dest[4] = { frame_buffer, nullptr, nullptr, nullptr };
+    int dest_linesize[4] = { video_reader_output_linesize(videoReaderState.output_width), 0, 0, 0 };
+    return video_reader_convert_frame(dest, dest_linesize);
+}
+
+void VideoReader::video_reader_align_region(int* x, int* y, int* w, int* h) const {
+    const auto& state = videoReaderState;
+    auto pix_fmt = correct_for_deprecated_pixel_format(state.av_codec_ctx->pix_fmt);
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+    const int align_x = desc ? 1 << desc->log2_chroma_w : 1;
+    const int align_y = desc ? 1 << desc->log2_chroma_h : 1;
+
+    int x0 = FFMAX(*x, 0) & ~(align_x - 1);
+    int y0 = FFMAX(*y, 0) & ~(align_y - 1);
+    int x1 = FFMIN(FFALIGN(*x + *w, align_x), state.width);
+    int y1 = FFMIN(FFALIGN(*y + *h, align_y), state.height);
+    *x = x0;
+    *y = y0;
+    *w = FFMAX(x1 - x0, 0);
+    *h = FFMAX(y1 - y0, 0);
+}
+
+// Points `src` at pixel (x, y) of every plane of `frame`, x and y on the chroma
+// grid. False for formats whose planes can't be addressed like that.
+static bool crop_planes(const AVFrame* frame, AVPixelFormat pix_fmt, int x, int y, const uint8_t* src[4]) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL))) {
+        return false;
+    }
+
+    // bytes per pixel of every plane; chroma planes are subsampled unless RGB
+    const int planes = av_pix_fmt_count_planes(pix_fmt);
+    int step[4] = { 0, 0, 0, 0 };
+    bool subsampled[4] = { false, false, false, false };
+    if (planes == 1) {
+        step[0] = av_get_padded_bits_per_pixel(desc) / 8;
+    } else {
+        for (int c = 0; c < desc->nb_components; ++c) {
+            step[desc->comp[c].plane] = desc->comp[c].step;
+            if ((c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+                subsampled[desc->comp[c].plane] = true;
+            }
+        }
+    }
+
+    for (int p = 0; p < 4; ++p) {
+        src[p] = nullptr;
+    }
+    for (int p = 0; p < planes; ++p) {
+        int px = subsampled[p] ? x >> desc->log2_chroma_w : x;
+        int py = subsampled[p] ? y >> desc->log2_chroma_h : y;
+        src[p] = frame->data[p] + (ptrdiff_t)py * frame->linesize[p] + (ptrdiff_t)px * step[p];
+    }
+    return true;
+}
+
+bool VideoReader::video_reader_convert_region(const AVFrame* frame, int x, int y, int w, int h,
+                                              uint8_t* const dest[4], const int dest_linesize[4]) {
+    if (!frame) {
+        frame = videoReaderState.av_frame;
+    }
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+    auto pix_fmt = correct_for_deprecated_pixel_format((AVPixelFormat)frame->format);
+    return convert_cropped(frame, pix_fmt, x, y, w, h, dest, dest_linesize);
+}
+
+AVPixelFormat VideoReader::video_reader_set_output_formats(const AVPixelFormat* formats, int count) {
+    auto& output_pix_fmt = videoReaderState.output_pix_fmt;
+    auto source_pix_fmt = correct_for_deprecated_pixel_format(videoReaderState.av_codec_ctx->pix_fmt);
+
+    // frame_buffer and the single destination plane limit what can be delivered
+    auto deliverable = [](AVPixelFormat pix_fmt) {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+        return desc && av_pix_fmt_count_planes(pix_fmt) == 1 && av_get_padded_bits_per_pixel(desc) <= 32 &&
+               !(desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL));
+    };
+
+    AVPixelFormat preferred = AV_PIX_FMT_NONE;
+    for (int i = 0; i < count; ++i) {
+        if (!deliverable(formats[i])) {
+            report("Can't deliver frames as %s\n", av_get_pix_fmt_name(formats[i]));
+            continue;
+        }
+        if (formats[i] == source_pix_fmt) {
+            output_pix_fmt = source_pix_fmt;
+            return output_pix_fmt;
+        }
+        if (preferred == AV_PIX_FMT_NONE) {
+            preferred = formats[i];
+        }
+    }
+    output_pix_fmt = preferred != AV_PIX_FMT_NONE ? preferred : AV_PIX_FMT_RGB0;
+    return output_pix_fmt;
+}
+
+int VideoReader::video_reader_output_linesize(int w) const {
+    return av_image_get_linesize(videoReaderState.output_pix_fmt, w, 0);
+}
+
+void VideoReader::video_reader_set_convert_pool(WorkerPool* pool, int bands) {
+    convert_pool = pool;
+    convert_bands = bands;
+}
+
+bool VideoReader::convert_cropped(const AVFrame* frame, AVPixelFormat pix_fmt, int x, int y, int w, int h,
+                                  uint8_t* const dest[4], const int dest_linesize[4]) {
+    // Below this a band is not worth a task
+    constexpr int MIN_BAND_PIXELS = 256 * 1024;
+
+    const uint8_t* src[4];
+    if (!crop_planes(frame, pix_fmt, x, y, src)) {
+        return false;
+    }
+
+    const auto output_pix_fmt = videoReaderState.output_pix_fmt;
+    if (pix_fmt == output_pix_fmt) {
+        // already in the consumer's format, a copy is all it takes
+        const int row_bytes = av_image_get_linesize(pix_fmt, w, 0);
+        av_image_copy_plane(dest[0], dest_linesize[0], src[0], frame->linesize[0], row_bytes, h);
+        passed_through = true;
+        bands_converted = 1;
+        bytes_converted = (size_t)row_bytes * h;
+        return true;
+    }
+
+    int bands = 1;
+    if (convert_pool) {
+        bands = convert_bands > 0 ? convert_bands : (int)convert_pool->size() + 1;
+        bands = FFMIN(bands, FFMAX((int)((int64_t)w * h / MIN_BAND_PIXELS), 1));
+        bands = FFMIN(bands, VIDEO_READER_MAX_BANDS);
+    }
+
+    if (bands == 1) {
+        auto& roi_scaler_ctx = videoReaderState.roi_scaler_ctx;
+        roi_scaler_ctx = sws_getCachedContext(roi_scaler_ctx, w, h, pix_fmt, w, h, output_pix_fmt,
+                                              SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!roi_scaler_ctx) {
+            report("Couldn't initialize sw scaler\n");
+            return false;
+        }
+        sws_scale(roi_scaler_ctx, src, frame->linesize, 0, h, dest, dest_linesize);
+    } else {
+        // band heights are a multiple of the chroma height so every band
+        // starts on a chroma row, the last band takes the remainder
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+        const int align_y = 1 << desc->log2_chroma_h;
+        const int band_height = FFALIGN((h + bands - 1) / bands, align_y);
+        bands = (h + band_height - 1) / band_height;
+
+        std::atomic<bool> ok{true};
+        convert_pool->parallelFor((size_t)bands, [&](size_t i) {
+            const int band_y = (int)i * band_height;
+            const int band_h = FFMIN(band_height, h - band_y);
+            auto& ctx = videoReaderState.band_scaler_ctxs[i];
+            ctx = sws_getCachedContext(ctx, w, band_h, pix_fmt, w, band_h, output_pix_fmt,
+                                       SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (!ctx) {
+                ok = false;
+                return;
+            }
+            const uint8_t* band_src[4];
+            crop_planes(frame, pix_fmt, x, y + band_y, band_src);
+            uint8_t* band_dest[4] = { dest[0] + (ptrdiff_t)band_y * dest_linesize[0], nullptr, nullptr, nullptr };
+            sws_scale(ctx, band_src, frame->linesize, 0, band_h, band_dest, dest_linesize);
+        });
+        if (!ok) {
+            report("Couldn't initialize sw scaler\n");
+            return false;
+        }
+    }
+    passed_through = false;
+    bands_converted = bands;
+    bytes_converted = (size_t)dest_linesize[0] * h;
+    return true;
+}
+
+void VideoReader::video_reader_set_output_size(int width, int height) {
+    videoReaderState.output_width = width;
+    videoReaderState.output_height = height;
+}
+
+bool VideoReader::video_reader_decode_frame() {
 
     // Unpack members of state
-    auto& width = videoReaderState.width;
-    auto& height = videoReaderState.height;
     auto& av_format_ctx = videoReaderState.av_format_ctx;
     auto& av_codec_ctx = videoReaderState.av_codec_ctx;
     auto& video_stream_index = videoReaderState.video_stream_index;
     auto& av_frame = videoReaderState.av_frame;
     auto& av_packet = videoReaderState.av_packet;
-    auto& sws_scaler_ctx = videoReaderState.sws_scaler_ctx;
 
     // Decode one frame
     int response;
+    bool got_frame = false;
     while (av_read_frame(av_format_ctx, av_packet) >= 0) {
         if (av_packet->stream_index != video_stream_index) {
             av_packet_unref(av_packet);
@@ -43,7 +254,7 @@ bool VideoReader::video_reader_read_frame() {
 
         response = avcodec_send_packet(av_codec_ctx, av_packet);
         if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
+            report("Failed to decode packet: %s\n", av_make_error(response));
             return false;
         }
 
@@ -52,31 +263,56 @@ bool VideoReader::video_reader_read_frame() {
             av_packet_unref(av_packet);
             continue;
         } else if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
+            report("Failed to decode packet: %s\n", av_make_error(response));
             return false;
         }
 
         av_packet_unref(av_packet);
+        got_frame = true;
         break;
     }
+    if (!got_frame) {
+        // end of file
+        return false;
+    }
 
     *pts = av_frame->pts;
+    return true;
+}
 
-    // Set up sws scaler
-    if (!sws_scaler_ctx) {
-        auto source_pix_fmt = correct_for_deprecated_pixel_format(av_codec_ctx->pix_fmt);
-        sws_scaler_ctx = sws_getContext(width, height, source_pix_fmt,
-                                        width, height, AV_PIX_FMT_RGB0,
-                                        SWS_BILINEAR, nullptr, nullptr, nullptr);
+bool VideoReader::video_reader_convert_frame(uint8_t* const dest[4], const int dest_linesize[4]) {
+
+    // Unpack members of state
+    auto& width = videoReaderState.width;
+    auto& height = videoReaderState.height;
+    auto& output_width = videoReaderState.output_width;
+    auto& output_height = videoReaderState.output_height;
+    auto& av_codec_ctx = videoReaderState.av_codec_ctx;
+    auto& av_frame = videoReaderState.av_frame;
+    auto& sws_scaler_ctx = videoReaderState.sws_scaler_ctx;
+
+    // Frames in the output format are copied and big ones converted in bands,
+    // both only at the source size
+    auto source_pix_fmt = correct_for_deprecated_pixel_format(av_codec_ctx->pix_fmt);
+    const bool passthrough = source_pix_fmt == videoReaderState.output_pix_fmt;
+    if ((convert_pool || passthrough) && output_width == width && output_height == height &&
+        convert_cropped(av_frame, source_pix_fmt, 0, 0, width, height, dest, dest_linesize)) {
+        return true;
     }
+
+    // Set up sws scaler, a cached context is reused while the sizes match
+    sws_scaler_ctx = sws_getCachedContext(sws_scaler_ctx, width, height, source_pix_fmt,
+                                          output_width, output_height, videoReaderState.output_pix_fmt,
+                                          SWS_BILINEAR, nullptr, nullptr, nullptr);
     if (!sws_scaler_ctx) {
-        printf("Couldn't initialize sw scaler\n");
+        report("Couldn't initialize sw scaler\n");
         return false;
     }
 
-    uint8_t* dest[4] = { frame_buffer, nullptr, nullptr, nullptr };
-    int dest_linesize[4] = { width * 4, 0, 0, 0 };
     sws_scale(sws_scaler_ctx, av_frame->data, av_frame->linesize, 0, av_frame->height, dest, dest_linesize);
+    bytes_converted = (size_t)dest_linesize[0] * output_height;
+    bands_converted = 1;
+    passed_through = false;
 
     return true;
 }
@@ -104,7 +340,7 @@ bool VideoReader::video_reader_seek_frame(int64_t ts) {
 
         response = avcodec_send_packet(av_codec_ctx, av_packet);
         if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
+            report("Failed to decode packet: %s\n", av_make_error(response));
             return false;
         }
 
@@ -113,7 +349,7 @@ bool VideoReader::video_reader_seek_frame(int64_t ts) {
             av_packet_unref(av_packet);
             continue;
         } else if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
+            report("Failed to decode packet: %s\n", av_make_error(response));
             return false;
         }
 
@@ -126,6 +362,10 @@ bool VideoReader::video_reader_seek_frame(int64_t ts) {
 
 void VideoReader::video_reader_close() {
     sws_freeContext(videoReaderState.sws_scaler_ctx);
+    sws_freeContext(videoReaderState.roi_scaler_ctx);
+    for (auto* ctx : videoReaderState.band_scaler_ctxs) {
+        sws_freeContext(ctx);
+    }
     avformat_close_input(&videoReaderState.av_format_ctx);
     avformat_free_context(videoReaderState.av_format_ctx);
     av_frame_free(&videoReaderState.av_frame);
@@ -147,12 +387,12 @@ bool VideoReader::video_reader_open(const char *filename) {
     // Open the file using libavformat
     av_format_ctx = avformat_alloc_context();
     if (!av_format_ctx) {
-        printf("Couldn't created AVFormatContext\n");
+        report("Couldn't created AVFormatContext\n");
         return false;
     }
 
     if (avformat_open_input(&av_format_ctx, filename, nullptr, nullptr) != 0) {
-        printf("Couldn't open video file\n");
+        report("Couldn't open video file\n");
         return false;
     }
 
@@ -170,60 +410,80 @@ bool VideoReader::video_reader_open(const char *filename) {
             video_stream_index = i;
             width = av_codec_params->width;
             height = av_codec_params->height;
+            videoReaderState.output_width = width;
+            videoReaderState.output_height = height;
+            videoReaderState.output_pix_fmt = AV_PIX_FMT_RGB0;
             time_base = av_format_ctx->streams[i]->time_base;
             break;
         }
     }
     if (video_stream_index == -1) {
-        printf("Couldn't find valid video stream inside file\n");
+        report("Couldn't find valid video stream inside file\n");
         return false;
     }
 
     // Set up a codec context for the decoder
     av_codec_ctx = avcodec_alloc_context3(av_codec);
     if (!av_codec_ctx) {
-        printf("Couldn't create AVCodecContext\n");
+        report("Couldn't create AVCodecContext\n");
         return false;
     }
     if (avcodec_parameters_to_context(av_codec_ctx, av_codec_params) < 0) {
-        printf("Couldn't initialize AVCodecContext\n");
+        report("Couldn't initialize AVCodecContext\n");
         return false;
     }
     if (avcodec_open2(av_codec_ctx, av_codec, nullptr) < 0) {
-        printf("Couldn't open codec\n");
+        report("Couldn't open codec\n");
         return false;
     }
 
     av_frame = av_frame_alloc();
     if (!av_frame) {
-        printf("Couldn't allocate AVFrame\n");
+        report("Couldn't allocate AVFrame\n");
         return false;
     }
     av_packet = av_packet_alloc();
     if (!av_packet) {
-        printf("Couldn't allocate AVPacket\n");
+        report("Couldn't allocate AVPacket\n");
         return false;
     }
 
     return true;
 }
 
-VideoReader::VideoReader(const char *filename) {
+void VideoReader::report(const char* format, ...) const {
+    if (flags & VIDEO_READER_QUIET) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+VideoReader::VideoReader(const char *filename, int flags) : flags(flags) {
+    // the destructor doesn't run when the constructor throws, so whatever
+    // video_reader_open got to is freed here
     if (!this->video_reader_open(filename)) {
+        this->video_reader_close();
         throw std::invalid_argument("Couldn't open video file (make sure you set a video file that exists)");
     }
 
-    constexpr int ALIGNMENT = 128;
-    const int frame_width = this->videoReaderState.width;
-    const int frame_height = this->videoReaderState.height;
-    //posix_memalign replacement
-    this->frame_buffer = static_cast<uint8_t *>(_aligned_malloc(frame_width * frame_height * 4, ALIGNMENT));
-    if (!frame_buffer) {
-        throw std::runtime_error("Couldn't allocate frame buffer");
+    if (!(flags & VIDEO_READER_NO_FRAME_BUFFER)) {
+        constexpr int ALIGNMENT = 128;
+        const int frame_width = this->videoReaderState.width;
+        const int frame_height = this->videoReaderState.height;
+        this->frame_buffer = alloc_frame_buffer((size_t)frame_width * frame_height * 4, ALIGNMENT);
+        if (!frame_buffer) {
+            this->video_reader_close();
+            throw std::runtime_error("Couldn't allocate frame buffer");
+        }
     }
     this->pts = static_cast<int64_t *>(malloc(sizeof(int64_t)));
 }
 
 VideoReader::~VideoReader() {
     this->video_reader_close();
+    free_frame_buffer(this->frame_buffer);
+    free(this->pts);
 }
@@ -4,13 +4,30 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
 #include <inttypes.h>
 }
 
+class WorkerPool;
+
+// most bands a frame is split into for parallel conversion
+#define VIDEO_READER_MAX_BANDS 32
+
+// VideoReader flags
+// skip frame_buffer, frames are only delivered by video_reader_convert_frame
+#define VIDEO_READER_NO_FRAME_BUFFER 0x1
+// failures only show in return values, nothing is printed (worker threads)
+#define VIDEO_READER_QUIET 0x2
+
 struct VideoReaderState {
     // Public things for other parts of the program to read from
     int width, height;
     AVRational time_base;
+    // size video_reader_convert_frame scales to, the frame size by default
+    int output_width, output_height;
+    // format frames are delivered in, see video_reader_set_output_formats
+    AVPixelFormat output_pix_fmt;
 
     // Private internal state
     AVFormatContext* av_format_ctx;
@@ -19,17 +36,65 @@ struct VideoReaderState {
     AVFrame* av_frame;
     AVPacket* av_packet;
     SwsContext* sws_scaler_ctx;
+    SwsContext* roi_scaler_ctx;
+    SwsContext* band_scaler_ctxs[VIDEO_READER_MAX_BANDS];
 };
 class VideoReader {
 public:
-    explicit VideoReader(const char* filename);
+    explicit VideoReader(const char* filename, int flags = 0);
+    ~VideoReader();
     VideoReaderState videoReaderState{};
-    uint8_t* frame_buffer;
+    uint8_t* frame_buffer = nullptr; // nullptr with VIDEO_READER_NO_FRAME_BUFFER
     int64_t* pts{};
+    // bytes written by the last video_reader_convert_frame
+    size_t bytes_converted = 0;
+    // true if the last frame was copied as decoded instead of converted
+    bool passed_through = false;
     bool video_reader_open(const char* filename);
+    // decode + convert into frame_buffer, false without one
     bool video_reader_read_frame();
+    // Decodes the next frame without converting it, false at the end of the file.
+    bool video_reader_decode_frame();
+    // Converts the last decoded frame to output_pix_fmt (output_width *
+    // output_height pixels) into caller provided planes, e.g. a mapped GL
+    // buffer, instead of frame_buffer.
+    bool video_reader_convert_frame(uint8_t* const dest[4], const int dest_linesize[4]);
+    // Scales converted frames to `width` x `height`; frame_buffer only holds
+    // frames up to the source size.
+    void video_reader_set_output_size(int width, int height);
+    // Packed formats of at most 4 bytes per pixel the consumer can take, most
+    // preferred first. If the decoder already outputs one of them frames are
+    // only copied, otherwise converted to the first one. RGB0 until set.
+    // Returns the format frames will be delivered in.
+    AVPixelFormat video_reader_set_output_formats(const AVPixelFormat* formats, int count);
+    // bytes per row of a w pixel wide frame in output_pix_fmt
+    int video_reader_output_linesize(int w) const;
+    // Grows a rectangle of the source frame to the chroma subsampling grid
+    // (e.g. even coordinates for 4:2:0) and clips it to the frame.
+    void video_reader_align_region(int* x, int* y, int* w, int* h) const;
+    // Converts only an aligned rectangle of `frame` (the last decoded frame if
+    // nullptr) to output_pix_fmt at its source size, by pointing the scaler at
+    // the cropped planes. Returns false for formats that can't be cropped.
+    bool video_reader_convert_region(const AVFrame* frame, int x, int y, int w, int h,
+                                     uint8_t* const dest[4], const int dest_linesize[4]);
+    // Converts large frames in horizontal bands on `pool` (and the calling
+    // thread), each band with its own scaler context. Bands start on the chroma
+    // grid; `bands` = 0 picks one per pool thread plus the caller, nullptr
+    // converts with one sws_scale call. Scaled output is always converted in
+    // one call since the filter reaches across band edges.
+    void video_reader_set_convert_pool(WorkerPool* pool, int bands = 0);
+    // bands used by the last conversion
+    int bands_converted = 1;
     bool video_reader_seek_frame(int64_t ts);
     void video_reader_close();
+
 private:
-    ~VideoReader();
+    // printf unless VIDEO_READER_QUIET
+    void report(const char* format, ...) const;
+    bool convert_cropped(const AVFrame* frame, AVPixelFormat pix_fmt, int x, int y, int w, int h,
+                         uint8_t* const dest[4], const int dest_linesize[4]);
+
+    WorkerPool* convert_pool = nullptr;
+    int convert_bands = 0;
+    int flags = 0;
 };
@@ -0,0 +1,100 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+WorkerPool::WorkerPool(size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+size_t WorkerPool::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+void WorkerPool::run()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            // finish what was queued before stopping
+            if (m_tasks.empty())
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+    if (count == 0)
+        return;
+    if (count == 1)
+    {
+        fn(0);
+        return;
+    }
+
+    // helpers that start after all indices are taken return right away, the
+    // caller only waits for indices that are actually being worked on
+    struct Shared
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto shared = std::make_shared<Shared>();
+    auto work = [shared, count, &fn]() {
+        size_t i;
+        while ((i = shared->next.fetch_add(1)) < count)
+        {
+            fn(i);
+            if (shared->done.fetch_add(1) + 1 == count)
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->finished.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = std::min(count - 1, size());
+    for (size_t i = 0; i < helpers; i++)
+        submit(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&] { return shared->done.load() == count; });
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by everything that decodes or converts
+// in the background, so the thread count doesn't grow with the number of
+// open streams.
+class WorkerPool
+{
+public:
+    // 0 = one thread per hardware thread
+    explicit WorkerPool(size_t threads = 0);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Runs fn(0) .. fn(count - 1) on the pool and the calling thread and
+    // returns when all are done. The caller works through the indices itself,
+    // so this is safe to call from inside a pool task.
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+    size_t size() const { return m_threads.size(); }
+    // tasks submitted but not started yet
+    size_t pending() const;
+
+private:
+    void run();
+
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stop = false;
+};